@@ -0,0 +1,150 @@
+#include "AnimatedTexture.h"
+#include <cstdint>
+#include "stb_image.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Like browsers: GIFs asking for less than this play at DEFAULT_DELAY_MS per frame
+	int const MIN_DELAY_MS = 20;
+	int const DEFAULT_DELAY_MS = 100;
+}
+
+AnimatedTexture::AnimatedTexture(ThreadPool & pool, int ring_size)
+	: pool(pool), stream(nullptr), ring(ring_size > 1 ? ring_size : 2), head(0), ready(0),
+	decoding(false), stopping(false), failed(false), id(0), width(0), height(0),
+	untilNextMs(0.0), framesShown(0), uploadedBytes(0)
+{
+}
+
+AnimatedTexture::~AnimatedTexture()
+{
+	Release();
+}
+
+bool AnimatedTexture::Open(char const * img_name)
+{
+	Release();
+	if (!file.Open(img_name) || file.Size() > static_cast<size_t>(INT32_MAX))
+		return false;
+	// The stream's buffers live from one decode task to the next, so no DecodeArena::Scope here
+	stream = stbi_gif_stream_open_from_memory(file.Data(), static_cast<int>(file.Size()), &width, &height);
+	if (stream == nullptr) {
+		file.Close();
+		return false;
+	}
+	// Set on the stream: the pool workers' own flip settings belong to whatever else they decode
+	stbi_gif_stream_set_flip_vertically(stream, true);
+	for (Frame & frame : ring)
+		frame.pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);	// no mips: they would need rebuilding every frame
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, ring[0].pixels.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	head = ready = 0;
+	untilNextMs = 0.0;
+	framesShown = 0;
+	uploadedBytes = 0;
+	decoding = true;
+	pool.Submit([this]() { decodeAhead(); });
+	return true;
+}
+
+void AnimatedTexture::Release()
+{
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		stopping = true;
+		idle.wait(guard, [this] { return !decoding; });
+		stopping = false;
+		failed = false;
+	}
+	if (stream != nullptr)
+		stbi_gif_stream_close(stream);
+	stream = nullptr;
+	if (id != 0)
+		glDeleteTextures(1, &id);
+	id = 0;
+	for (Frame & frame : ring)
+		std::vector<unsigned char>().swap(frame.pixels);
+	file.Close();
+}
+
+// Decodes into the slots after the ready frames until the ring is full. Only this task touches
+// the stream and those slots; Update only reads the ready ones.
+void AnimatedTexture::decodeAhead()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (!stopping && ready < ring.size()) {
+		Frame & frame = ring[(head + ready) % ring.size()];
+		guard.unlock();
+		int got = stbi_gif_stream_next(stream, frame.pixels.data(), 0, 4, &frame.delayMs, frame.rect);
+		if (got == 0 && stbi_gif_stream_rewind(stream))
+			got = stbi_gif_stream_next(stream, frame.pixels.data(), 0, 4, &frame.delayMs, frame.rect);
+		guard.lock();
+		if (got != 1) {
+			failed = true;
+			break;
+		}
+		++ready;
+	}
+	decoding = false;
+	idle.notify_all();
+}
+
+void AnimatedTexture::Update(double elapsed_ms)
+{
+	if (stream == nullptr)
+		return;
+	untilNextMs -= elapsed_ms;
+	std::unique_lock<std::mutex> guard(lock);
+	while (untilNextMs <= 0.0) {
+		if (ready == 0) {
+			untilNextMs = 0.0;	// show the next frame as soon as it is decoded, without catching up
+			break;
+		}
+		Frame const & frame = ring[head];
+		guard.unlock();
+		upload(frame);
+		untilNextMs += frame.delayMs >= MIN_DELAY_MS ? frame.delayMs : DEFAULT_DELAY_MS;
+		guard.lock();
+		head = (head + 1) % ring.size();
+		--ready;
+	}
+	if (!decoding && !failed && ready < ring.size()) {
+		decoding = true;
+		pool.Submit([this]() { decodeAhead(); });
+	}
+}
+
+// The texture holds the previous frame, so the changed rectangle is all it needs
+void AnimatedTexture::upload(Frame const & frame)
+{
+	++framesShown;
+	int x = frame.rect[0], y = frame.rect[1], w = frame.rect[2], h = frame.rect[3];
+	if (w <= 0 || h <= 0)
+		return;
+	glBindTexture(GL_TEXTURE_2D, id);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, x);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, y);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, frame.pixels.data());
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	uploadedBytes += static_cast<size_t>(w) * h * 4;
+}
+
+GLuint AnimatedTexture::Bind(unsigned unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, id);
+	return id;
+}
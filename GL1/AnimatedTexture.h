@@ -0,0 +1,67 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "MappedFile.h"
+
+class ThreadPool;
+struct stbi__gif_stream;
+
+// Animated GIF played back on a single RGBA texture. Frames are decoded one at a time on the
+// pool, a few ahead of playback, into a small ring of reusable frame buffers; each frame shown
+// uploads only the rectangle that changed since the one before. Memory stays the same however
+// many frames the file has. Loops forever.
+class AnimatedTexture
+{
+public:
+	explicit AnimatedTexture(ThreadPool & pool, int ring_size = 3);
+	~AnimatedTexture();
+	AnimatedTexture(AnimatedTexture const &) = delete;
+	AnimatedTexture & operator=(AnimatedTexture const &) = delete;
+
+	// Maps img_name, creates the texture and starts decoding. The first frame appears on the
+	// first Update after it is ready.
+	bool Open(char const * img_name);
+	void Release();	// must run while the GL context is still current
+
+	// Advances playback by elapsed_ms and uploads the frames that came due, in order. When the
+	// decoder falls behind, the current frame just stays up longer.
+	void Update(double elapsed_ms);
+
+	GLuint Bind(unsigned unit = 0);
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	unsigned FramesShown() const { return framesShown; }
+	size_t UploadedBytes() const { return uploadedBytes; }
+
+private:
+	struct Frame
+	{
+		std::vector<unsigned char> pixels;	// whole frame, RGBA, bottom row first
+		int rect[4];						// x, y, w, h that changed since the previous frame
+		int delayMs;
+	};
+
+	ThreadPool & pool;
+	MappedFile file;
+	stbi__gif_stream * stream;
+	std::vector<Frame> ring;
+	size_t head;		// next frame to show
+	size_t ready;		// decoded frames waiting from head on
+	bool decoding;		// a decodeAhead task is queued or running
+	bool stopping;
+	bool failed;
+	std::mutex lock;	// guards head, ready, decoding, stopping and failed
+	std::condition_variable idle;
+	GLuint id;
+	int width, height;
+	double untilNextMs;
+	unsigned framesShown;
+	size_t uploadedBytes;
+
+	void decodeAhead();
+	void upload(Frame const & frame);
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <cmath>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -39,35 +40,116 @@ public:
 		Yaw(yaw),
 		MovementSpeed(camSpeed),
 		MouseSensitivity(CAM_MOUSE_SENSITIVITY),
-		Zoom(zoom)
+		Zoom(zoom),
+		aspect(16.0f / 9.0f),
+		nearPlane(0.1f),
+		farPlane(100.0f),
+		depthMode(DEPTH_STANDARD),
+		viewDirty(true),
+		projectionDirty(true),
+		viewProjectionDirty(true),
+		version(0)
 	{
 		updateCameraVectors();
 	}
 
-	glm::mat4 GetViewMatrix()
+	// Rebuilt only after the camera has moved or turned
+	glm::mat4 const & GetViewMatrix()
 	{
-		//return glm::lookAt(Position, Position + Forward, Up);
-
-		glm::vec3 zaxis = -Forward;
-		glm::vec3 xaxis = Right;
-		glm::vec3 yaxis = Up;
-
-		float arr1[]{
-			xaxis.x, xaxis.y, xaxis.z, 0,
-			yaxis.x, yaxis.y, yaxis.z, 0,
-			zaxis.x, zaxis.y, zaxis.z, 0,
-			0,0,0,1,
-		};
-		float arr2[]{
-			1,0,0,-Position.x,
-			0,1,0,-Position.y,
-			0,0,1,-Position.z,
-			0,0,0,1,
-		};
-		glm::mat4 mat1 = glm::transpose(glm::make_mat4(arr1));
-		glm::mat4 mat2 = glm::transpose(glm::make_mat4(arr2));
-		glm::mat4 lookAt = mat1 * mat2;
-		return lookAt;
+		if (viewDirty) {
+			// Rows are the camera axes (z opposite to where it looks), translation their dot with -Position;
+			// the same as glm::lookAt(Position, Position + Forward, Up) without the matrix product
+			glm::vec3 zaxis = -Forward;
+			view = glm::mat4(1.0f);
+			view[0][0] = Right.x;	view[1][0] = Right.y;	view[2][0] = Right.z;	view[3][0] = -glm::dot(Right, Position);
+			view[0][1] = Up.x;		view[1][1] = Up.y;		view[2][1] = Up.z;		view[3][1] = -glm::dot(Up, Position);
+			view[0][2] = zaxis.x;	view[1][2] = zaxis.y;	view[2][2] = zaxis.z;	view[3][2] = -glm::dot(zaxis, Position);
+			viewDirty = false;
+			viewProjectionDirty = true;
+		}
+		return view;
+	}
+
+	// How depth is mapped. DEPTH_REVERSE_INFINITE puts the near plane at depth 1 and infinity at 0,
+	// with no far plane: it needs glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE), a depth clear
+	// of 0 and GL_GEQUAL, and keeps depth precision spread evenly with a floating-point buffer
+	enum DepthMode
+	{
+		DEPTH_STANDARD,
+		DEPTH_REVERSE_INFINITE,
+	};
+
+	// Rebuilt only after the zoom, the viewport size or the depth settings have changed
+	glm::mat4 const & GetProjectionMatrix()
+	{
+		if (projectionDirty) {
+			if (depthMode == DEPTH_REVERSE_INFINITE) {
+				float f = 1.0f / std::tan(glm::radians(Zoom) * 0.5f);
+				projection = glm::mat4(0.0f);
+				projection[0][0] = f / aspect;
+				projection[1][1] = f;
+				projection[2][3] = -1.0f;		// w = -z
+				projection[3][2] = nearPlane;	// depth = near / -z
+			}
+			else {
+				projection = glm::perspective(glm::radians(Zoom), aspect, nearPlane, farPlane);
+			}
+			projectionDirty = false;
+			viewProjectionDirty = true;
+		}
+		return projection;
+	}
+
+	glm::mat4 const & GetViewProjectionMatrix()
+	{
+		GetViewMatrix();
+		GetProjectionMatrix();
+		if (viewProjectionDirty) {
+			viewProjection = projection * view;
+			viewProjectionDirty = false;
+			++version;
+		}
+		return viewProjection;
+	}
+
+	// Changes whenever GetViewProjectionMatrix returns something new, so callers holding
+	// uniforms set from the matrices can tell whether they need setting again
+	unsigned Version()
+	{
+		GetViewProjectionMatrix();
+		return version;
+	}
+
+	// Size of the viewport drawn into, for the aspect ratio. Ignored while either is 0 (minimized).
+	void SetViewportSize(int width, int height)
+	{
+		if (width <= 0 || height <= 0)
+			return;
+		float ratio = static_cast<float>(width) / static_cast<float>(height);
+		if (ratio != aspect) {
+			aspect = ratio;
+			projectionDirty = true;
+		}
+	}
+
+	// far_plane is unused with DEPTH_REVERSE_INFINITE
+	void SetDepthRange(float near_plane, float far_plane, DepthMode mode = DEPTH_STANDARD)
+	{
+		nearPlane = near_plane;
+		farPlane = far_plane;
+		depthMode = mode;
+		projectionDirty = true;
+	}
+
+	DepthMode GetDepthMode() const { return depthMode; }
+
+	// Leaves the cached view alone when the position doesn't actually change
+	void SetPosition(glm::vec3 const & position)
+	{
+		if (position != Position) {
+			Position = position;
+			viewDirty = true;
+		}
 	}
 
 	void Translate(glm::vec3 dir, float deltaTime)
@@ -75,6 +157,7 @@ public:
 		float v = MovementSpeed * deltaTime;
 		dir = glm::normalize(dir);
 		Position += dir * v;
+		viewDirty = true;
 
 		/*float v = MovementSpeed * deltaTime;
 		dir = glm::normalize(dir);
@@ -108,6 +191,7 @@ public:
 			Zoom = 1.0f;
 		if (Zoom > 45.0f)
 			Zoom = 45.0f;
+		projectionDirty = true;
 	}
 
 	void SetForward(glm::vec3 const & forward)
@@ -117,6 +201,20 @@ public:
 	}
 
 private:
+	float aspect;
+	float nearPlane;
+	float farPlane;
+	DepthMode depthMode;
+
+	// Cached matrices; Position, the angles and Zoom are public, so change them through the methods
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	bool viewDirty;
+	bool projectionDirty;
+	bool viewProjectionDirty;
+	unsigned version;
+
 	// calculates the front vector from the Camera's (updated) Euler Angles
 	void updateCameraVectors()
 	{
@@ -130,5 +228,6 @@ private:
 		// also re-calculate the Right and Up vector
 		Right = glm::normalize(glm::cross(Forward, WorldUp));  // normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
 		Up = glm::normalize(glm::cross(Right, Forward));
+		viewDirty = true;
 	}
 };
\ No newline at end of file
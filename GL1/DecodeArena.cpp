@@ -0,0 +1,224 @@
+#include "DecodeArena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+	// Every block starts with one of these; arena is null for plain heap blocks.
+	struct BlockHeader
+	{
+		DecodeArena * arena;
+		size_t size;
+	};
+
+	// Keeps the blocks as aligned as malloc's on x64, which the SSE2 paths expect
+	size_t const ALIGNMENT = 16;
+	size_t const HEADER_BYTES = 16;
+	static_assert(sizeof(BlockHeader) <= HEADER_BYTES, "block header doesn't fit");
+
+	// Arenas grow in steps of this, up to a limit past which big decodes just use the heap
+	size_t const CHUNK_GRANULARITY = 1 << 20;
+	size_t const MAX_CHUNK_BYTES = 64 << 20;
+
+	thread_local DecodeArena * active = nullptr;
+
+	std::mutex totalsLock;
+	DecodeAllocStats totals;
+
+	size_t roundUp(size_t n, size_t to)
+	{
+		return (n + to - 1) / to * to;
+	}
+
+	BlockHeader * headerOf(void * block)
+	{
+		return reinterpret_cast<BlockHeader *>(static_cast<unsigned char *>(block) - HEADER_BYTES);
+	}
+
+	void * heapAllocate(DecodeArena * arena, size_t size)
+	{
+		BlockHeader * header = static_cast<BlockHeader *>(std::malloc(HEADER_BYTES + size));
+		if (header == nullptr)
+			return nullptr;
+		header->arena = arena;
+		header->size = size;
+		return reinterpret_cast<unsigned char *>(header) + HEADER_BYTES;
+	}
+
+	DecodeArena & threadArena()
+	{
+		static thread_local DecodeArena arena;
+		return arena;
+	}
+}
+
+DecodeArena::Scope::Scope()
+	: previous(active)
+{
+	active = &threadArena();
+}
+
+DecodeArena::Scope::~Scope()
+{
+	// Only the outermost scope rewinds; inner ones share its decode
+	if (previous == nullptr)
+		active->rewind();
+	active = previous;
+}
+
+DecodeArena::DecodeArena()
+	: chunk(nullptr), capacity(0), top(0), fallbackBytes(0)
+{
+}
+
+DecodeArena::~DecodeArena()
+{
+	std::free(chunk);
+}
+
+void * DecodeArena::Malloc(size_t size)
+{
+	return active != nullptr ? active->allocate(size) : heapAllocate(nullptr, size);
+}
+
+void * DecodeArena::Realloc(void * block, size_t size)
+{
+	if (block == nullptr)
+		return Malloc(size);
+	BlockHeader * header = headerOf(block);
+	if (header->arena != nullptr)
+		return header->arena->reallocate(block, size);
+	header = static_cast<BlockHeader *>(std::realloc(header, HEADER_BYTES + size));
+	if (header == nullptr)
+		return nullptr;
+	header->size = size;
+	return reinterpret_cast<unsigned char *>(header) + HEADER_BYTES;
+}
+
+void DecodeArena::Free(void * block)
+{
+	if (block == nullptr)
+		return;
+	BlockHeader * header = headerOf(block);
+	if (header->arena != nullptr)
+		header->arena->release(block);
+	else
+		std::free(header);
+}
+
+DecodeAllocStats DecodeArena::Totals()
+{
+	std::lock_guard<std::mutex> lock(totalsLock);
+	return totals;
+}
+
+void DecodeArena::ResetTotals()
+{
+	std::lock_guard<std::mutex> lock(totalsLock);
+	totals = DecodeAllocStats();
+}
+
+void * DecodeArena::allocate(size_t size)
+{
+	size_t bytes = HEADER_BYTES + roundUp(size, ALIGNMENT);
+	void * block;
+	++stats.allocations;
+	if (bytes <= capacity - top) {
+		BlockHeader * header = reinterpret_cast<BlockHeader *>(chunk + top);
+		header->arena = this;
+		header->size = size;
+		top += bytes;
+		block = reinterpret_cast<unsigned char *>(header) + HEADER_BYTES;
+	}
+	else {
+		block = heapAllocate(this, size);
+		if (block == nullptr)
+			return nullptr;
+		++stats.heapFallbacks;
+		fallbackBytes += HEADER_BYTES + size;
+	}
+	stats.peakBytes = std::max(stats.peakBytes, top + fallbackBytes);
+	return block;
+}
+
+void * DecodeArena::reallocate(void * block, size_t size)
+{
+	BlockHeader * header = headerOf(block);
+	++stats.reallocs;
+	if (owns(block)) {
+		size_t start = reinterpret_cast<unsigned char *>(header) - chunk;
+		size_t end = start + HEADER_BYTES + roundUp(header->size, ALIGNMENT);
+		size_t newEnd = start + HEADER_BYTES + roundUp(size, ALIGNMENT);
+		if (end == top && newEnd <= capacity) {
+			// The last block can grow (zlib's output buffer, mostly) or shrink where it is
+			top = newEnd;
+			header->size = size;
+			++stats.reallocsInPlace;
+			stats.peakBytes = std::max(stats.peakBytes, top + fallbackBytes);
+			return block;
+		}
+		if (size <= header->size) {
+			++stats.reallocsInPlace;
+			return block;
+		}
+	}
+	else {
+		size_t oldSize = header->size;
+		header = static_cast<BlockHeader *>(std::realloc(header, HEADER_BYTES + size));
+		if (header == nullptr)
+			return nullptr;
+		header->size = size;
+		fallbackBytes = fallbackBytes - oldSize + size;
+		stats.peakBytes = std::max(stats.peakBytes, top + fallbackBytes);
+		return reinterpret_cast<unsigned char *>(header) + HEADER_BYTES;
+	}
+
+	void * moved = allocate(size);
+	if (moved == nullptr)
+		return nullptr;
+	std::memcpy(moved, block, header->size);
+	release(block);
+	return moved;
+}
+
+void DecodeArena::release(void * block)
+{
+	BlockHeader * header = headerOf(block);
+	if (owns(block)) {
+		// Only the last block's space can be handed back before the rewind
+		size_t start = reinterpret_cast<unsigned char *>(header) - chunk;
+		if (start + HEADER_BYTES + roundUp(header->size, ALIGNMENT) == top)
+			top = start;
+	}
+	else {
+		fallbackBytes -= HEADER_BYTES + header->size;
+		std::free(header);
+	}
+}
+
+void DecodeArena::rewind()
+{
+	stats.images = 1;
+	{
+		std::lock_guard<std::mutex> lock(totalsLock);
+		totals.images += stats.images;
+		totals.allocations += stats.allocations;
+		totals.reallocs += stats.reallocs;
+		totals.reallocsInPlace += stats.reallocsInPlace;
+		totals.heapFallbacks += stats.heapFallbacks;
+		totals.peakBytes = std::max(totals.peakBytes, stats.peakBytes);
+	}
+
+	// Grow to fit the biggest decode so far, so the next one like it never leaves the arena
+	if (stats.peakBytes > capacity && capacity < MAX_CHUNK_BYTES) {
+		size_t wanted = std::min(roundUp(stats.peakBytes, CHUNK_GRANULARITY), MAX_CHUNK_BYTES);
+		std::free(chunk);
+		chunk = static_cast<unsigned char *>(std::malloc(wanted));
+		capacity = (chunk != nullptr) ? wanted : 0;
+	}
+	top = 0;
+	fallbackBytes = 0;
+	stats = DecodeAllocStats();
+}
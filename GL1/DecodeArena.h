@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+
+// Allocation numbers of the decodes that ran inside a DecodeArena::Scope.
+struct DecodeAllocStats
+{
+	size_t images;
+	size_t allocations;			// STBI_MALLOC calls, and reallocs that had to move the block
+	size_t reallocs;
+	size_t reallocsInPlace;		// grown where they were because nothing was allocated after them
+	size_t heapFallbacks;		// requests that didn't fit the arena and went to malloc
+	size_t peakBytes;			// most memory a single decode held at once
+
+	DecodeAllocStats() : images(0), allocations(0), reallocs(0), reallocsInPlace(0), heapFallbacks(0), peakBytes(0) {}
+};
+
+// Per-thread bump allocator behind stb_image's STBI_MALLOC/STBI_REALLOC/STBI_FREE hooks.
+// While a Scope is alive on a thread, that thread's decoder allocations come out of its own
+// arena, so parallel decodes never meet in the heap; the arena is rewound when the Scope ends
+// and grows to fit the largest decode it has seen. Outside a Scope the hooks fall through to
+// malloc, so buffers returned by stbi_load keep working with stbi_image_free anywhere.
+// Nothing allocated inside a Scope may outlive it: decode into a buffer allocated beforehand.
+// Every block, malloc fallbacks included, sits behind a 16-byte header, so memory stb_image
+// returns (pixels, GIF delays, ...) must go back through stbi_image_free, never free().
+class DecodeArena
+{
+public:
+	class Scope
+	{
+	public:
+		Scope();
+		~Scope();
+		Scope(Scope const &) = delete;
+		Scope & operator=(Scope const &) = delete;
+
+	private:
+		DecodeArena * previous;
+	};
+
+	static void * Malloc(size_t size);
+	static void * Realloc(void * block, size_t size);
+	static void Free(void * block);
+
+	// Summed over every thread since the last ResetTotals
+	static DecodeAllocStats Totals();
+	static void ResetTotals();
+
+	DecodeArena();
+	~DecodeArena();
+	DecodeArena(DecodeArena const &) = delete;
+	DecodeArena & operator=(DecodeArena const &) = delete;
+
+private:
+	unsigned char * chunk;
+	size_t capacity;
+	size_t top;				// bytes of chunk in use
+	size_t fallbackBytes;	// live heap blocks allocated on behalf of this decode
+	DecodeAllocStats stats;	// this decode only
+
+	void * allocate(size_t size);
+	void * reallocate(void * block, size_t size);
+	void release(void * block);
+	void rewind();
+	bool owns(void const * block) const { return static_cast<unsigned char const *>(block) >= chunk && static_cast<unsigned char const *>(block) < chunk + capacity; }
+};
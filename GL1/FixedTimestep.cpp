@@ -0,0 +1,32 @@
+#include "FixedTimestep.h"
+#include <algorithm>
+
+FixedTimestep::FixedTimestep(unsigned steps_per_second, unsigned max_steps_per_frame)
+	: step(std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / std::max(1u, steps_per_second)),
+	accumulator(Clock::duration::zero()), last(Clock::now()), steps(0), maxSteps(std::max(1u, max_steps_per_frame))
+{
+	stepSeconds = std::chrono::duration<double>(step).count();
+}
+
+unsigned FixedTimestep::Advance()
+{
+	Clock::time_point now = Clock::now();
+	accumulator += now - last;
+	last = now;
+
+	unsigned due = 0;
+	while (accumulator >= step && due < maxSteps) {
+		accumulator -= step;
+		++due;
+	}
+	if (accumulator >= step)
+		accumulator %= step;
+	steps += due;
+	return due;
+}
+
+void FixedTimestep::Reset()
+{
+	last = Clock::now();
+	accumulator = Clock::duration::zero();
+}
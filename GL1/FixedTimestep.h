@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// Clock for a simulation that advances in fixed steps whatever the frame rate. Each frame,
+// Advance() adds the real time that passed (integer steady_clock ticks, so nothing drifts over
+// long uptimes) and says how many steps are due; Alpha() is how far the frame lies between the
+// last step and the next, for interpolating what gets drawn.
+class FixedTimestep
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// A frame never runs more than max_steps_per_frame steps; time beyond that is dropped, so
+	// after a long stall the simulation slows down instead of never catching up.
+	explicit FixedTimestep(unsigned steps_per_second, unsigned max_steps_per_frame = 8);
+
+	unsigned Advance();
+	void Reset();	// forgets the time since the last Advance, e.g. after loading
+
+	double StepSeconds() const { return stepSeconds; }
+	uint64_t Steps() const { return steps; }	// since construction
+	double Alpha() const { return static_cast<double>(accumulator.count()) / static_cast<double>(step.count()); }
+
+	// Simulated time of the frame being drawn: the last step plus Alpha()
+	double Seconds() const { return (static_cast<double>(steps) + Alpha()) * stepSeconds; }
+
+private:
+	Clock::duration step;
+	Clock::duration accumulator;	// real time not simulated yet, less than one step after Advance
+	Clock::time_point last;
+	double stepSeconds;
+	uint64_t steps;
+	unsigned maxSteps;
+};
@@ -0,0 +1,253 @@
+#include "ImageIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include "MappedFile.h"
+#include "stb_image.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// On-disk layout: header, count entries, then pathBytes of NUL-terminated paths.
+	uint32_t const INDEX_MAGIC = 0x58444947;	// "GIDX"
+	uint32_t const INDEX_VERSION = 1;
+
+	struct IndexHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t count;
+		uint32_t pathBytes;
+	};
+
+	char const * const IMAGE_EXTENSIONS[] = { "png", "jpg", "jpeg", "bmp", "gif", "tga", "psd", "hdr", "pic", "pnm", "ppm", "pgm" };
+
+	struct FileInfo
+	{
+		std::string path;
+		uint64_t size;
+		int64_t time;
+	};
+
+	bool hasImageExtension(char const * name)
+	{
+		char const * dot = std::strrchr(name, '.');
+		if (dot == nullptr)
+			return false;
+		std::string ext(dot + 1);
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+		for (char const * known : IMAGE_EXTENSIONS)
+			if (ext == known)
+				return true;
+		return false;
+	}
+
+	std::string joinPath(std::string const & directory, char const * name)
+	{
+		return directory == "." ? std::string(name) : directory + "/" + name;
+	}
+
+	// Regular files with an image extension directly in directory
+	bool listImages(std::string const & directory, std::vector<FileInfo> & files)
+	{
+#ifdef _WIN32
+		WIN32_FIND_DATAA found;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &found);
+		if (find == INVALID_HANDLE_VALUE)
+			return false;
+		do {
+			if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !hasImageExtension(found.cFileName))
+				continue;
+			FileInfo file;
+			file.path = joinPath(directory, found.cFileName);
+			file.size = (static_cast<uint64_t>(found.nFileSizeHigh) << 32) | found.nFileSizeLow;
+			file.time = static_cast<int64_t>((static_cast<uint64_t>(found.ftLastWriteTime.dwHighDateTime) << 32) | found.ftLastWriteTime.dwLowDateTime);
+			files.push_back(file);
+		} while (FindNextFileA(find, &found));
+		FindClose(find);
+#else
+		DIR * dir = opendir(directory.c_str());
+		if (dir == nullptr)
+			return false;
+		while (dirent * found = readdir(dir)) {
+			if (!hasImageExtension(found->d_name))
+				continue;
+			FileInfo file;
+			file.path = joinPath(directory, found->d_name);
+			struct stat info;
+			if (stat(file.path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+				continue;
+			file.size = static_cast<uint64_t>(info.st_size);
+			file.time = static_cast<int64_t>(info.st_mtime);
+			files.push_back(file);
+		}
+		closedir(dir);
+#endif
+		return true;
+	}
+
+	// stbi_info says whether it could read the header, not which format it was
+	int detectFormat(unsigned char const * bytes, size_t size)
+	{
+		if (size >= 4 && std::memcmp(bytes, "\x89PNG", 4) == 0)
+			return ImageIndexEntry::FORMAT_PNG;
+		if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xD8)
+			return ImageIndexEntry::FORMAT_JPEG;
+		if (size >= 4 && std::memcmp(bytes, "GIF8", 4) == 0)
+			return ImageIndexEntry::FORMAT_GIF;
+		if (size >= 2 && std::memcmp(bytes, "BM", 2) == 0)
+			return ImageIndexEntry::FORMAT_BMP;
+		if (size >= 4 && std::memcmp(bytes, "8BPS", 4) == 0)
+			return ImageIndexEntry::FORMAT_PSD;
+		if (size >= 2 && std::memcmp(bytes, "#?", 2) == 0)
+			return ImageIndexEntry::FORMAT_HDR;
+		if (size >= 4 && std::memcmp(bytes, "\x53\x80\xF6\x34", 4) == 0)
+			return ImageIndexEntry::FORMAT_PIC;
+		if (size >= 2 && bytes[0] == 'P' && (bytes[1] == '5' || bytes[1] == '6'))
+			return ImageIndexEntry::FORMAT_PNM;
+		return ImageIndexEntry::FORMAT_TGA;	// the one format without a signature
+	}
+
+	// Maps the file, but only the pages holding its header are ever read
+	bool probe(FileInfo const & file, ImageIndexEntry & entry)
+	{
+		MappedFile mapped;
+		if (!mapped.Open(file.path.c_str()) || mapped.Size() > static_cast<size_t>(INT32_MAX))
+			return false;
+		int len = static_cast<int>(mapped.Size());
+		int w, h, comp;
+		if (!stbi_info_from_memory(mapped.Data(), len, &w, &h, &comp))
+			return false;
+		entry.width = w;
+		entry.height = h;
+		entry.channels = static_cast<uint8_t>(comp);
+		entry.bitsPerChannel = stbi_is_hdr_from_memory(mapped.Data(), len) ? 32 : stbi_is_16_bit_from_memory(mapped.Data(), len) ? 16 : 8;
+		entry.format = static_cast<uint8_t>(detectFormat(mapped.Data(), mapped.Size()));
+		return true;
+	}
+}
+
+bool ImageIndex::Build(std::string const & directory, ThreadPool & pool, ImageIndex const * previous)
+{
+	std::vector<FileInfo> files;
+	if (!listImages(directory, files))
+		return false;
+
+	std::vector<ImageIndexEntry> found(files.size());
+	std::vector<char> indexed(files.size(), 0);
+	pool.ParallelFor(static_cast<unsigned>(files.size()), [&](unsigned i) {
+		FileInfo const & file = files[i];
+		ImageIndexEntry const * old = previous != nullptr ? previous->Find(file.path) : nullptr;
+		if (old != nullptr && old->fileSize == file.size && old->fileTime == file.time) {
+			found[i] = *old;
+			indexed[i] = 1;
+			return;
+		}
+		ImageIndexEntry & entry = found[i];
+		std::memset(&entry, 0, sizeof(entry));
+		entry.pathHash = TextureCache::HashBytes(reinterpret_cast<unsigned char const *>(file.path.data()), file.path.size());
+		entry.fileSize = file.size;
+		entry.fileTime = file.time;
+		indexed[i] = probe(file, entry) ? 1 : 0;
+	});
+
+	std::vector<size_t> order;
+	for (size_t i(0); i < files.size(); ++i)
+		if (indexed[i])
+			order.push_back(i);
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return found[a].pathHash < found[b].pathHash; });
+
+	entries.clear();
+	paths.clear();
+	for (size_t i : order) {
+		ImageIndexEntry entry = found[i];
+		entry.pathOffset = static_cast<uint32_t>(paths.size());
+		paths.insert(paths.end(), files[i].path.begin(), files[i].path.end());
+		paths.push_back('\0');
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+bool ImageIndex::Save(std::string const & path) const
+{
+	IndexHeader header;
+	header.magic = INDEX_MAGIC;
+	header.version = INDEX_VERSION;
+	header.count = static_cast<uint32_t>(entries.size());
+	header.pathBytes = static_cast<uint32_t>(paths.size());
+
+	// Same as the texture cache: a temporary name first, so a crash never leaves half an index
+	std::string tmpPath = path + ".tmp";
+	FILE * f = std::fopen(tmpPath.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1
+		&& std::fwrite(entries.data(), sizeof(ImageIndexEntry), entries.size(), f) == entries.size()
+		&& std::fwrite(paths.data(), 1, paths.size(), f) == paths.size();
+	ok = std::fclose(f) == 0 && ok;
+	std::remove(path.c_str());	// rename() won't replace an existing index on Windows
+	if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool ImageIndex::Load(std::string const & path)
+{
+	entries.clear();
+	paths.clear();
+	MappedFile index;
+	if (!index.Open(path.c_str()) || index.Size() < sizeof(IndexHeader))
+		return false;
+
+	IndexHeader header;
+	std::memcpy(&header, index.Data(), sizeof(header));
+	if (header.magic != INDEX_MAGIC || header.version != INDEX_VERSION)
+		return false;
+	size_t entryBytes = static_cast<size_t>(header.count) * sizeof(ImageIndexEntry);
+	if (index.Size() != sizeof(IndexHeader) + entryBytes + header.pathBytes)
+		return false;	// truncated or from a different build
+	if (header.pathBytes != 0 && index.Data()[index.Size() - 1] != '\0')
+		return false;
+
+	entries.resize(header.count);
+	std::memcpy(entries.data(), index.Data() + sizeof(IndexHeader), entryBytes);
+	paths.assign(index.Data() + sizeof(IndexHeader) + entryBytes, index.Data() + index.Size());
+	for (ImageIndexEntry const & entry : entries) {
+		if (entry.pathOffset >= paths.size()) {
+			entries.clear();
+			paths.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+ImageIndexEntry const * ImageIndex::Find(std::string const & path) const
+{
+	uint64_t hash = TextureCache::HashBytes(reinterpret_cast<unsigned char const *>(path.data()), path.size());
+	auto it = std::lower_bound(entries.begin(), entries.end(), hash, [](ImageIndexEntry const & entry, uint64_t h) { return entry.pathHash < h; });
+	for (; it != entries.end() && it->pathHash == hash; ++it)
+		if (path == Path(*it))
+			return &*it;
+	return nullptr;
+}
+
+char const * ImageIndex::FormatName(int format)
+{
+	static char const * const NAMES[] = { "unknown", "png", "jpeg", "bmp", "gif", "tga", "psd", "hdr", "pic", "pnm" };
+	return format >= 0 && format < static_cast<int>(sizeof(NAMES) / sizeof(NAMES[0])) ? NAMES[format] : NAMES[0];
+}
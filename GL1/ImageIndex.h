@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// What an image's header says about it, learned without decoding any pixels.
+// Stored as is in the index file.
+struct ImageIndexEntry
+{
+	enum Format
+	{
+		FORMAT_UNKNOWN,
+		FORMAT_PNG,
+		FORMAT_JPEG,
+		FORMAT_BMP,
+		FORMAT_GIF,
+		FORMAT_TGA,
+		FORMAT_PSD,
+		FORMAT_HDR,
+		FORMAT_PIC,
+		FORMAT_PNM,
+	};
+
+	uint64_t pathHash;		// TextureCache::HashBytes of the path as indexed
+	uint64_t fileSize;
+	int64_t fileTime;		// modification time; with the size, tells whether the entry is stale
+	int32_t width;
+	int32_t height;
+	uint8_t channels;		// in the file
+	uint8_t bitsPerChannel;	// 8 or 16, or 32 for float (HDR)
+	uint8_t format;
+	uint8_t reserved;
+	uint32_t pathOffset;	// into the index's path table
+};
+
+// Header-only index of the images in an asset directory: sizes, channels and bit depths
+// known before any decode starts, so texture memory can be planned up front. Building it
+// maps each file and reads just its header (stbi_info), spread over a thread pool; it is
+// kept in a compact binary file so the next run only re-reads files that changed.
+class ImageIndex
+{
+public:
+	// Indexes the image files directly in directory, not its subdirectories. Entries of previous
+	// for files whose size and modification time haven't changed are reused without reading them.
+	bool Build(std::string const & directory, ThreadPool & pool, ImageIndex const * previous = nullptr);
+
+	bool Save(std::string const & path) const;
+	bool Load(std::string const & path);	// false, and empty, when missing or unreadable
+
+	// path as it was indexed: directory + "/" + file name, or just the name for "."
+	ImageIndexEntry const * Find(std::string const & path) const;
+	std::vector<ImageIndexEntry> const & Entries() const { return entries; }
+	char const * Path(ImageIndexEntry const & entry) const { return paths.data() + entry.pathOffset; }
+
+	static char const * FormatName(int format);
+
+private:
+	std::vector<ImageIndexEntry> entries;	// sorted by pathHash
+	std::vector<char> paths;				// NUL-terminated, in entry order
+};
@@ -0,0 +1,115 @@
+#include "ImageLoader.h"
+#include <climits>
+#include <utility>
+#include "DecodeArena.h"
+#include "MappedFile.h"
+#include "stb_image.h"
+
+namespace
+{
+	void poolParallelFor(void * user, int count, stbi_parallel_task * task, void * task_data)
+	{
+		static_cast<ThreadPool *>(user)->ParallelFor(static_cast<unsigned>(count), [task, task_data](unsigned i) { task(task_data, static_cast<int>(i)); });
+	}
+
+	// Decodes with this thread's arena behind every decoder allocation. Only the pixels outlive
+	// the decode, so they go to a heap buffer allocated up front that stbi_image_free can release.
+	unsigned char * decodeInArena(unsigned char const * data, size_t size, int * width, int * height, int * channels, int req_comp)
+	{
+		int len = static_cast<int>(size);
+		int fileChannels;
+		if (!stbi_info_from_memory(data, len, width, height, &fileChannels))
+			return nullptr;
+		int outChannels = req_comp ? req_comp : fileChannels;
+		if (*width <= 0 || *height <= 0 || outChannels <= 0 || static_cast<double>(*width) * *height * outChannels > INT_MAX)
+			return stbi_load_from_memory(data, len, width, height, channels, req_comp);	// let the decoder report it
+		size_t bytes = static_cast<size_t>(*width) * *height * outChannels;
+		unsigned char * pixels = static_cast<unsigned char *>(DecodeArena::Malloc(bytes));
+		if (pixels == nullptr)
+			return nullptr;
+
+		DecodeArena::Scope scope;
+		if (!stbi_load_into_from_memory(data, len, width, height, channels, outChannels, pixels, 0, bytes)) {
+			DecodeArena::Free(pixels);
+			return nullptr;
+		}
+		return pixels;
+	}
+}
+
+LoadedImage::~LoadedImage()
+{
+	if (pixels != nullptr)
+		stbi_image_free(pixels);
+}
+
+LoadedImage::LoadedImage(LoadedImage && other)
+	: LoadedImage()
+{
+	*this = std::move(other);
+}
+
+LoadedImage & LoadedImage::operator=(LoadedImage && other)
+{
+	if (this != &other) {
+		std::swap(width, other.width);
+		std::swap(height, other.height);
+		std::swap(channels, other.channels);
+		std::swap(pixels, other.pixels);
+		std::swap(error, other.error);
+	}
+	return *this;
+}
+
+LoadedImage ImageLoader::Load(ImageSource const & source, int req_comp, bool flip_vertically)
+{
+	LoadedImage img;
+	stbi_set_flip_vertically_on_load_thread(flip_vertically);
+	if (source.data != nullptr) {
+		img.pixels = decodeInArena(source.data, source.size, &img.width, &img.height, &img.channels, req_comp);
+	}
+	else {
+		// Hand the whole mapping to the decoder as a memory context: no stdio buffer refills, no copies
+		MappedFile file;
+		if (file.Open(source.path.c_str(), MappedFile::ACCESS_SEQUENTIAL))
+			img.pixels = decodeInArena(file.Data(), file.Size(), &img.width, &img.height, &img.channels, req_comp);
+		else
+			img.pixels = stbi_load(source.path.c_str(), &img.width, &img.height, &img.channels, req_comp);	// pipes, empty files, ...
+	}
+	if (img.pixels == nullptr)
+		img.error = stbi_failure_reason();
+	return img;
+}
+
+void ImageLoader::EnableParallelJpeg(ThreadPool * pool)
+{
+	if (pool != nullptr)
+		stbi_set_jpeg_parallel_for(poolParallelFor, pool);
+	else
+		stbi_set_jpeg_parallel_for(nullptr, nullptr);
+}
+
+std::vector<std::future<LoadedImage>> ImageLoader::LoadMany(std::vector<ImageSource> const & sources, int req_comp, bool flip_vertically)
+{
+	std::vector<std::future<LoadedImage>> results;
+	results.reserve(sources.size());
+	for (ImageSource const & source : sources)
+		results.push_back(pool.Async([source, req_comp, flip_vertically]() { return Load(source, req_comp, flip_vertically); }));
+	return results;
+}
+
+void ImageLoader::LoadMany(std::vector<ImageSource> const & sources, int req_comp, bool flip_vertically, Callback on_loaded)
+{
+	std::vector<std::future<void>> done;
+	done.reserve(sources.size());
+	for (size_t i(0); i < sources.size(); ++i) {
+		ImageSource const * source = &sources[i];
+		Callback const * callback = &on_loaded;
+		done.push_back(pool.Async([source, i, req_comp, flip_vertically, callback]() {
+			LoadedImage img = Load(*source, req_comp, flip_vertically);
+			(*callback)(i, img);
+		}));
+	}
+	for (std::future<void> & f : done)
+		f.get();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+// Something to decode: a file on disk or an encoded image already in memory (not owned).
+struct ImageSource
+{
+	std::string path;
+	unsigned char const * data;
+	size_t size;
+
+	static ImageSource FromFile(std::string const & path) { ImageSource s; s.path = path; return s; }
+	static ImageSource FromMemory(unsigned char const * data, size_t size) { ImageSource s; s.data = data; s.size = size; return s; }
+
+	ImageSource() : data(nullptr), size(0) {}
+};
+
+// Result of one decode; owns the stbi pixel buffer.
+struct LoadedImage
+{
+	int width;
+	int height;
+	int channels;		// channels in the file; pixels has req_comp channels when one was requested
+	unsigned char * pixels;
+	char const * error;	// stbi_failure_reason() when pixels is null
+
+	LoadedImage() : width(0), height(0), channels(0), pixels(nullptr), error(nullptr) {}
+	~LoadedImage();
+	LoadedImage(LoadedImage && other);
+	LoadedImage & operator=(LoadedImage && other);
+	LoadedImage(LoadedImage const &) = delete;
+	LoadedImage & operator=(LoadedImage const &) = delete;
+};
+
+// stbi_load_many: decodes a batch of images in parallel on a ThreadPool.
+// Every task sets stb_image's per-thread flip flag, so concurrent batches never race on it.
+class ImageLoader
+{
+public:
+	typedef std::function<void(size_t index, LoadedImage & image)> Callback;
+
+	explicit ImageLoader(ThreadPool & pool) : pool(pool) {}
+
+	// One future per source, in the same order
+	std::vector<std::future<LoadedImage>> LoadMany(std::vector<ImageSource> const & sources, int req_comp = 0, bool flip_vertically = true);
+
+	// Calls on_loaded on the decoding worker as each image finishes; returns once all are done.
+	// The image is freed after the callback unless it moves the pixels out.
+	// Call from outside the pool: the calling thread blocks until the batch is finished.
+	void LoadMany(std::vector<ImageSource> const & sources, int req_comp, bool flip_vertically, Callback on_loaded);
+
+	static LoadedImage Load(ImageSource const & source, int req_comp = 0, bool flip_vertically = true);
+
+	// Lets stb_image decode the restart intervals of large JPEGs on pool's workers; applies to
+	// every decode in the process. Pass nullptr to go back to serial decoding before the pool dies.
+	static void EnableParallelJpeg(ThreadPool * pool);
+
+private:
+	ThreadPool & pool;
+};
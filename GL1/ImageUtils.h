@@ -0,0 +1,23 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// 2x2 box filter down to the next mip level; odd edges repeat the last texel
+inline void HalveImage(unsigned char const * src, int width, int height, int channels, std::vector<unsigned char> & dst)
+{
+	int dstW = std::max(1, width / 2), dstH = std::max(1, height / 2);
+	dst.resize(static_cast<size_t>(dstW) * dstH * channels);
+	for (int y(0); y < dstH; ++y) {
+		unsigned char const * row0 = src + static_cast<size_t>(std::min(2 * y, height - 1)) * width * channels;
+		unsigned char const * row1 = src + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width * channels;
+		unsigned char * out = dst.data() + static_cast<size_t>(y) * dstW * channels;
+		for (int x(0); x < dstW; ++x) {
+			int x0 = std::min(2 * x, width - 1) * channels, x1 = std::min(2 * x + 1, width - 1) * channels;
+			for (int c(0); c < channels; ++c) {
+				int sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+				*out++ = static_cast<unsigned char>((sum + 2) >> 2);
+			}
+		}
+	}
+}
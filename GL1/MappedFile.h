@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+
+// Read-only view of a whole file mapped into memory.
+// The mapping stays valid until Close() or the destructor.
+class MappedFile
+{
+public:
+	// How the mapping will be read, passed on to the OS read-ahead
+	enum AccessHint
+	{
+		ACCESS_DEFAULT,
+		ACCESS_SEQUENTIAL,	// one front-to-back pass, e.g. handing the file to a decoder
+	};
+
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile & operator=(MappedFile const &) = delete;
+	MappedFile(MappedFile && other);
+	MappedFile & operator=(MappedFile && other);
+
+	bool Open(char const * file_name, AccessHint hint = ACCESS_DEFAULT);
+	void Close();
+
+	bool IsOpen() const { return data != nullptr; }
+	unsigned char const * Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	unsigned char const * data;
+	size_t size;
+#ifdef _WIN32
+	void * fileHandle;
+	void * mappingHandle;
+#endif
+};
@@ -6,6 +6,8 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 class Shader
 {
@@ -111,6 +113,11 @@ public:
 		glUniform1f(glGetUniformLocation(id, name.c_str()), value);
 	}
 	// ------------------------------------------------------------------------
+	void setUniform2f(std::string const & name, float value1, float value2) const
+	{
+		glUniform2f(glGetUniformLocation(id, name.c_str()), value1, value2);
+	}
+	// ------------------------------------------------------------------------
 	void setUniform3f(std::string const & name, float value1, float value2, float value3) const
 	{
 		glUniform3f(glGetUniformLocation(id, name.c_str()), value1, value2, value3);
@@ -0,0 +1,176 @@
+#include "StreamDecoder.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include "stb_image.h"
+
+namespace
+{
+	// Enough for the header of every format; probing starts once this much has arrived
+	size_t const HEADER_PROBE_BYTES = 4096;
+}
+
+StreamDecoder::StreamDecoder(int req_comp, bool flip_vertically, RowsCallback on_rows)
+	: reqComp(req_comp), flipVertically(flip_vertically), onRows(std::move(on_rows)),
+	readPos(0), finished(false), cancelled(false), done(false), succeeded(false), error(nullptr),
+	width(0), height(0), channels(0), rowsReady(0)
+{
+	worker = std::thread(&StreamDecoder::run, this);
+}
+
+StreamDecoder::~StreamDecoder()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		cancelled = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+void StreamDecoder::Push(void const * data, size_t size)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		unsigned char const * bytes = static_cast<unsigned char const *>(data);
+		input.insert(input.end(), bytes, bytes + size);
+	}
+	changed.notify_all();
+}
+
+void StreamDecoder::Finish()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		finished = true;
+	}
+	changed.notify_all();
+}
+
+bool StreamDecoder::Wait()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this] { return done; });
+	return succeeded;
+}
+
+bool StreamDecoder::IsDone() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return done;
+}
+
+char const * StreamDecoder::Error() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return error;
+}
+
+void StreamDecoder::run()
+{
+	if (reqComp < 1 || reqComp > 4) {
+		end(false, "bad req_comp");
+		return;
+	}
+	if (!readHeader())
+		return;
+
+	stbi_io_callbacks callbacks = { &StreamDecoder::read, &StreamDecoder::skip, &StreamDecoder::eof };
+	int w, h, comp;
+	stbi_set_flip_vertically_on_load_thread(flipVertically);
+	if (stbi_load_into_from_callbacks(&callbacks, this, &w, &h, &comp, reqComp, pixels.data(), 0, pixels.size(), &StreamDecoder::rowsDone, this))
+		end(true, nullptr);
+	else
+		end(false, stbi_failure_reason());
+}
+
+// Waits for enough of the file to size the output
+bool StreamDecoder::readHeader()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	size_t probed = 0;
+	for (;;) {
+		changed.wait(guard, [&] { return cancelled || finished || input.size() >= std::max(probed + 1, HEADER_PROBE_BYTES); });
+		if (cancelled) {
+			guard.unlock();
+			end(false, "cancelled");
+			return false;
+		}
+		probed = input.size();
+		int w, h, comp;
+		if (stbi_info_from_memory(input.data(), static_cast<int>(input.size()), &w, &h, &comp) && w > 0 && h > 0) {
+			if (static_cast<double>(w) * h * reqComp > static_cast<double>(pixels.max_size())) {
+				guard.unlock();
+				end(false, "too large");
+				return false;
+			}
+			pixels.resize(static_cast<size_t>(w) * h * reqComp);
+			width = w;
+			height = h;
+			channels = comp;
+			return true;
+		}
+		if (finished) {
+			guard.unlock();
+			end(false, stbi_failure_reason());
+			return false;
+		}
+	}
+}
+
+void StreamDecoder::end(bool success, char const * reason)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = true;
+		succeeded = success;
+		error = reason;
+	}
+	changed.notify_all();
+}
+
+// stb_image's reads block until the whole request is there, so it never sees a short read
+// before the real end of the file
+int StreamDecoder::read(void * user, char * data, int size)
+{
+	StreamDecoder * self = static_cast<StreamDecoder *>(user);
+	std::unique_lock<std::mutex> guard(self->lock);
+	self->changed.wait(guard, [&] { return self->cancelled || self->finished || self->input.size() - self->readPos >= static_cast<size_t>(size); });
+	if (self->cancelled) {
+		// Jump to the end, so decoders that scan for more data before giving up stop at once
+		self->readPos = self->input.size();
+		return 0;
+	}
+	size_t n = std::min(self->input.size() - self->readPos, static_cast<size_t>(size));
+	std::memcpy(data, self->input.data() + self->readPos, n);
+	self->readPos += n;
+	return static_cast<int>(n);
+}
+
+void StreamDecoder::skip(void * user, int n)
+{
+	StreamDecoder * self = static_cast<StreamDecoder *>(user);
+	std::unique_lock<std::mutex> guard(self->lock);
+	if (n < 0) {
+		self->readPos -= std::min(self->readPos, static_cast<size_t>(-n));
+		return;
+	}
+	self->changed.wait(guard, [&] { return self->cancelled || self->finished || self->input.size() - self->readPos >= static_cast<size_t>(n); });
+	self->readPos = self->cancelled ? self->input.size() : std::min(self->input.size(), self->readPos + n);
+}
+
+int StreamDecoder::eof(void * user)
+{
+	StreamDecoder * self = static_cast<StreamDecoder *>(user);
+	std::unique_lock<std::mutex> guard(self->lock);
+	self->changed.wait(guard, [&] { return self->cancelled || self->finished || self->input.size() > self->readPos; });
+	return self->cancelled || self->input.size() == self->readPos;
+}
+
+void StreamDecoder::rowsDone(void * user, int first_row, int row_count)
+{
+	StreamDecoder * self = static_cast<StreamDecoder *>(user);
+	self->rowsReady += row_count;
+	if (self->onRows)
+		self->onRows(first_row, row_count);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Decodes an image while its bytes are still arriving (a download, a slow disk, ...).
+// Push() the encoded data as it comes in; the decoder runs as far as the data allows, and
+// baseline JPEGs and 8-bit PNGs finish their rows in bands long before the file is complete.
+// stb_image pulls its input, so the decode runs on a thread of its own that blocks in the
+// read callbacks until Push() or Finish() provide enough; a pool worker would be stuck there.
+class StreamDecoder
+{
+public:
+	// Called on the decoding thread as rows of Pixels() are finished. The rows are in Pixels()
+	// order: with flipping on, bands fill the image from the bottom.
+	typedef std::function<void(int first_row, int row_count)> RowsCallback;
+
+	// req_comp is required, 1..4
+	explicit StreamDecoder(int req_comp = 4, bool flip_vertically = true, RowsCallback on_rows = RowsCallback());
+	~StreamDecoder();	// abandons an unfinished decode
+	StreamDecoder(StreamDecoder const &) = delete;
+	StreamDecoder & operator=(StreamDecoder const &) = delete;
+
+	void Push(void const * data, size_t size);
+	// No more data: the decode finishes with what it has, or fails if that isn't enough
+	void Finish();
+
+	// Blocks until the decode is over; true if it succeeded
+	bool Wait();
+	bool IsDone() const;
+
+	// Zero until the header has arrived
+	int Width() const { return width; }
+	int Height() const { return height; }
+	int Channels() const { return channels; }	// in the file; Pixels() has req_comp
+	// Rows finished so far; with flipping on, they're the last RowsReady() rows of Pixels()
+	int RowsReady() const { return rowsReady; }
+	// Width() * Height() * req_comp bytes once the header has arrived. Rows may be read as soon
+	// as they're reported ready; the rest is still being written.
+	unsigned char const * Pixels() const { return pixels.empty() ? nullptr : pixels.data(); }
+	char const * Error() const;
+
+private:
+	int reqComp;
+	bool flipVertically;
+	RowsCallback onRows;
+
+	mutable std::mutex lock;
+	std::condition_variable changed;
+	std::vector<unsigned char> input;
+	size_t readPos;
+	bool finished;
+	bool cancelled;
+	bool done;
+	bool succeeded;
+	char const * error;
+
+	std::atomic<int> width;
+	std::atomic<int> height;
+	std::atomic<int> channels;
+	std::atomic<int> rowsReady;
+	std::vector<unsigned char> pixels;
+
+	std::thread worker;
+
+	void run();
+	bool readHeader();
+	void end(bool success, char const * reason);
+
+	static int read(void * user, char * data, int size);
+	static void skip(void * user, int n);
+	static int eof(void * user);
+	static void rowsDone(void * user, int first_row, int row_count);
+};
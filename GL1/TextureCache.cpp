@@ -0,0 +1,150 @@
+#include "TextureCache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "DecodeArena.h"
+#include "stb_image.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// On-disk layout: header followed by width * height * channels raw bytes.
+	uint32_t const CACHE_MAGIC = 0x58544c47;	// "GLTX"
+	uint32_t const CACHE_VERSION = 1;
+
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		int32_t width;
+		int32_t height;
+		int32_t channels;
+		uint32_t reserved;
+	};
+
+	bool makeDirectory(std::string const & dir)
+	{
+#ifdef _WIN32
+		return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+}
+
+TextureCache::TextureCache(std::string const & directory)
+	: directory(directory), directoryReady(false)
+{
+}
+
+uint64_t TextureCache::HashBytes(unsigned char const * bytes, size_t len, uint64_t seed)
+{
+	uint64_t h = seed;
+	for (size_t i(0); i < len; ++i) {
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+bool TextureCache::Load(char const * img_name, bool flip_vertically, DecodedImage & out)
+{
+	MappedFile source;
+	if (!source.Open(img_name, MappedFile::ACCESS_SEQUENTIAL))
+		return false;
+
+	// The flip setting changes the decoded bytes, so it is part of the key.
+	unsigned char flip = flip_vertically ? 1 : 0;
+	uint64_t key = HashBytes(source.Data(), source.Size());
+	key = HashBytes(&flip, 1, key);
+
+	std::string path = entryPath(key);
+	if (readEntry(path, key, out))
+		return true;
+
+	// Decode into the staging buffer rather than a fresh stbi allocation: the pixels are
+	// written once by the decoder and then read by the cache fill and the texture upload.
+	int width, height, channels;
+	int len = static_cast<int>(source.Size());
+	if (!stbi_info_from_memory(source.Data(), len, &width, &height, &channels))
+		return false;
+	staging.resize(static_cast<size_t>(width) * height * channels);
+	stbi_set_flip_vertically_on_load(flip_vertically);
+	{
+		DecodeArena::Scope scope;
+		if (!stbi_load_into_from_memory(source.Data(), len, &out.width, &out.height, &out.channels, channels, staging.data(), 0, staging.size()))
+			return false;
+	}
+	out.pixels = staging.data();
+	out.fromCache = false;
+	writeEntry(path, key, out);
+	return true;
+}
+
+std::string TextureCache::entryPath(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.tex", static_cast<unsigned long long>(key));
+	return directory + "/" + name;
+}
+
+bool TextureCache::readEntry(std::string const & path, uint64_t key, DecodedImage & out) const
+{
+	MappedFile entry;
+	if (!entry.Open(path.c_str()) || entry.Size() < sizeof(CacheHeader))
+		return false;
+
+	CacheHeader header;
+	std::memcpy(&header, entry.Data(), sizeof(header));
+	if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != key)
+		return false;
+	if (header.width <= 0 || header.height <= 0 || header.channels <= 0 || header.channels > 4)
+		return false;
+	size_t bytes = static_cast<size_t>(header.width) * header.height * header.channels;
+	if (entry.Size() != sizeof(CacheHeader) + bytes)
+		return false;	// truncated or stale entry
+
+	out.width = header.width;
+	out.height = header.height;
+	out.channels = header.channels;
+	out.pixels = entry.Data() + sizeof(CacheHeader);
+	out.fromCache = true;
+	out.mapping = std::move(entry);
+	return true;
+}
+
+void TextureCache::writeEntry(std::string const & path, uint64_t key, DecodedImage const & img)
+{
+	if (!directoryReady) {
+		directoryReady = makeDirectory(directory);
+		if (!directoryReady)
+			return;
+	}
+
+	CacheHeader header;
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.key = key;
+	header.width = img.width;
+	header.height = img.height;
+	header.channels = img.channels;
+	header.reserved = 0;
+	size_t bytes = static_cast<size_t>(img.width) * img.height * img.channels;
+
+	// Write to a temporary name first so a crash never leaves a half-written entry behind.
+	std::string tmpPath = path + ".tmp";
+	FILE * f = std::fopen(tmpPath.c_str(), "wb");
+	if (f == NULL)
+		return;
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1 && std::fwrite(img.pixels, 1, bytes, f) == bytes;
+	ok = std::fclose(f) == 0 && ok;
+	std::remove(path.c_str());	// rename() won't replace an existing (stale) entry on Windows
+	if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+		std::remove(tmpPath.c_str());
+}
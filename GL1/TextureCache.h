@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Decoded pixels of an image, either freshly decoded or mapped from the cache.
+// Freshly decoded pixels live in the cache's staging buffer and stay valid until its next Load.
+struct DecodedImage
+{
+	int width;
+	int height;
+	int channels;
+	bool fromCache;
+	unsigned char const * pixels;
+
+	DecodedImage() : width(0), height(0), channels(0), fromCache(false), pixels(nullptr) {}
+	DecodedImage(DecodedImage const &) = delete;
+	DecodedImage & operator=(DecodedImage const &) = delete;
+
+private:
+	friend class TextureCache;
+	MappedFile mapping;			// backing store for cache hits
+};
+
+// Disk cache of decoded texture pixels, keyed by a hash of the source file contents.
+// A hit maps the raw pixels straight from disk instead of running the PNG/JPEG decoder.
+class TextureCache
+{
+public:
+	explicit TextureCache(std::string const & directory = "texcache");
+
+	// Loads img_name, decoding (and filling the cache) only when no valid entry exists.
+	bool Load(char const * img_name, bool flip_vertically, DecodedImage & out);
+
+	// FNV-1a, 64 bit
+	static uint64_t HashBytes(unsigned char const * bytes, size_t len, uint64_t seed = 14695981039346656037ull);
+
+private:
+	std::string directory;
+	bool directoryReady;
+	std::vector<unsigned char> staging;	// cache misses decode straight into this, reused between loads
+
+	std::string entryPath(uint64_t key) const;
+	bool readEntry(std::string const & path, uint64_t key, DecodedImage & out) const;
+	void writeEntry(std::string const & path, uint64_t key, DecodedImage const & img);
+};
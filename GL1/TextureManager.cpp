@@ -0,0 +1,214 @@
+#include "TextureManager.h"
+#include "ImageUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace
+{
+	// Evicted textures keep at least this many texels on their longest side
+	int const MIN_EVICTED_SIZE = 64;
+}
+
+TextureManager::TextureManager(TextureCache & cache, size_t budget_bytes)
+	: cache(cache), frame(0)
+{
+	stats.budgetBytes = budget_bytes;
+}
+
+TextureManager::~TextureManager()
+{
+	ReleaseAll();
+}
+
+size_t TextureManager::MipChainBytes(int width, int height, int channels, int base_level)
+{
+	// RGB8 is padded to 4 bytes per texel by practically every driver
+	size_t texelBytes = (channels == 3) ? 4 : static_cast<size_t>(channels);
+	int w = std::max(1, width >> base_level), h = std::max(1, height >> base_level);
+	size_t bytes = 0;
+	for (;;) {
+		bytes += static_cast<size_t>(w) * h * texelBytes;
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	return bytes;
+}
+
+TextureManager::Handle TextureManager::Load(char const * img_name)
+{
+	Handle handle;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		handle = static_cast<Handle>(entries.size());
+		entries.push_back(Entry());
+	}
+
+	Entry & entry = entries[handle];
+	entry.id = 0;
+	entry.source = img_name;
+	entry.width = entry.height = entry.channels = 0;
+	entry.baseLevel = 0;
+	entry.bytes = 0;
+	entry.lastUsedFrame = frame;
+	entry.live = false;
+	if (!upload(entry, 0)) {
+		freeHandles.push_back(handle);
+		return INVALID_HANDLE;
+	}
+	entry.live = true;
+	entry.lruPos = lru.insert(lru.end(), handle);
+	++stats.textureCount;
+	return handle;
+}
+
+void TextureManager::Release(Handle handle)
+{
+	if (handle < 0 || handle >= static_cast<Handle>(entries.size()) || !entries[handle].live)
+		return;
+	Entry & entry = entries[handle];
+	glDeleteTextures(1, &entry.id);
+	stats.residentBytes -= entry.bytes;
+	--stats.textureCount;
+	lru.erase(entry.lruPos);
+	entry.live = false;
+	entry.id = 0;
+	freeHandles.push_back(handle);
+}
+
+void TextureManager::ReleaseAll()
+{
+	for (Handle handle(0); handle < static_cast<Handle>(entries.size()); ++handle)
+		Release(handle);
+}
+
+GLuint TextureManager::Bind(Handle handle, unsigned unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	if (handle < 0 || handle >= static_cast<Handle>(entries.size()) || !entries[handle].live) {
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return 0;
+	}
+
+	Entry & entry = entries[handle];
+	touch(handle);
+	if (entry.baseLevel > 0) {
+		// Stream the evicted mips back in; the budget is enforced again at the end of the frame
+		auto t_start = std::chrono::high_resolution_clock::now();
+		upload(entry, 0);
+		stats.lastStreamInMs = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - t_start).count();
+		stats.totalStreamInMs += stats.lastStreamInMs;
+		++stats.streamIns;
+	}
+	glBindTexture(GL_TEXTURE_2D, entry.id);
+	return entry.id;
+}
+
+void TextureManager::EndFrame()
+{
+	enforceBudget();
+	++frame;
+}
+
+void TextureManager::SetBudget(size_t budget_bytes)
+{
+	stats.budgetBytes = budget_bytes;
+}
+
+bool TextureManager::upload(Entry & entry, int base_level)
+{
+	auto t_load = std::chrono::high_resolution_clock::now();
+	DecodedImage img;
+	if (!cache.Load(entry.source.c_str(), true, img)) {
+		std::cout << "Fuck. Can't load image \"" << entry.source << "\"." << std::endl;
+		return false;
+	}
+	if (!entry.live) {
+		float load_ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(std::chrono::high_resolution_clock::now() - t_load).count();
+		printf("image \"%s\": width: %d, height: %d, nrChannels: %d, %s in %.2f ms\n", entry.source.c_str(), img.width, img.height, img.channels,
+			img.fromCache ? "mapped from cache" : "decoded", load_ms);
+	}
+	entry.width = img.width;
+	entry.height = img.height;
+	entry.channels = img.channels;
+
+	// Build the new base level on the CPU so only the retained mips ever reach the GPU
+	int w = img.width, h = img.height;
+	unsigned char const * pixels = img.pixels;
+	std::vector<unsigned char> scratch[2];
+	if (base_level > 0) {
+		for (int level(0); level < base_level; ++level) {
+			HalveImage(level == 0 ? img.pixels : scratch[level & 1].data(), w, h, img.channels, scratch[(level + 1) & 1]);
+			w = std::max(1, w / 2);
+			h = std::max(1, h / 2);
+		}
+		pixels = scratch[base_level & 1].data();
+	}
+
+	// A fresh texture object, so the dropped levels are actually released by the driver
+	if (entry.id != 0)
+		glDeleteTextures(1, &entry.id);
+	glGenTextures(1, &entry.id);
+	glBindTexture(GL_TEXTURE_2D, entry.id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	GLint format = (img.channels == 4) ? GL_RGBA : (img.channels == 3) ? GL_RGB : (img.channels == 2) ? GL_RG : GL_RED;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE, pixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	stats.residentBytes -= entry.bytes;
+	entry.bytes = MipChainBytes(img.width, img.height, img.channels, base_level);
+	stats.residentBytes += entry.bytes;
+	entry.baseLevel = base_level;
+	return true;
+}
+
+void TextureManager::touch(Handle handle)
+{
+	Entry & entry = entries[handle];
+	entry.lastUsedFrame = frame;
+	lru.splice(lru.end(), lru, entry.lruPos);
+}
+
+int TextureManager::minResidentLevel(Entry const & entry) const
+{
+	int level = 0;
+	int longest = std::max(entry.width, entry.height);
+	while ((longest >> (level + 1)) >= MIN_EVICTED_SIZE)
+		++level;
+	return level;
+}
+
+void TextureManager::enforceBudget()
+{
+	for (auto it = lru.begin(); it != lru.end() && stats.residentBytes > stats.budgetBytes; ++it) {
+		Entry & entry = entries[*it];
+		if (entry.lastUsedFrame == frame)
+			break;	// everything from here on was used this frame
+
+		// Drop as many levels as needed (or allowed) from this texture in a single re-upload
+		int floorLevel = minResidentLevel(entry);
+		int level = entry.baseLevel;
+		size_t bytes = entry.bytes;
+		while (level < floorLevel && stats.residentBytes - entry.bytes + bytes > stats.budgetBytes) {
+			++level;
+			bytes = MipChainBytes(entry.width, entry.height, entry.channels, level);
+		}
+		if (level != entry.baseLevel) {
+			stats.evictions += level - entry.baseLevel;
+			upload(entry, level);
+		}
+	}
+}
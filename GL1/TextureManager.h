@@ -0,0 +1,80 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <vector>
+#include "TextureCache.h"
+
+// Residency numbers, refreshed as textures are loaded, evicted and streamed back in.
+struct TextureStats
+{
+	size_t residentBytes;
+	size_t budgetBytes;
+	size_t textureCount;
+	unsigned evictions;			// mip levels dropped to stay within the budget
+	unsigned streamIns;			// evicted textures restored to full resolution
+	double lastStreamInMs;
+	double totalStreamInMs;
+
+	TextureStats() : residentBytes(0), budgetBytes(0), textureCount(0), evictions(0), streamIns(0), lastStreamInMs(0.0), totalStreamInMs(0.0) {}
+	double AvgStreamInMs() const { return streamIns ? totalStreamInMs / streamIns : 0.0; }
+};
+
+// Owns every GL texture created from an image file and keeps their total size under a budget.
+// When over budget, the least recently bound textures lose their top mip levels;
+// binding an evicted texture streams its full mip chain back in.
+class TextureManager
+{
+public:
+	typedef int Handle;
+	static Handle const INVALID_HANDLE = -1;
+
+	TextureManager(TextureCache & cache, size_t budget_bytes);
+	~TextureManager();
+	TextureManager(TextureManager const &) = delete;
+	TextureManager & operator=(TextureManager const &) = delete;
+
+	Handle Load(char const * img_name);
+	void Release(Handle handle);
+	void ReleaseAll();	// must run while the GL context is still current
+
+	// Binds the texture to GL_TEXTURE0 + unit at full resolution and marks it as recently used.
+	GLuint Bind(Handle handle, unsigned unit = 0);
+
+	// Call once per frame: evicts down to the budget and advances the LRU clock.
+	void EndFrame();
+
+	void SetBudget(size_t budget_bytes);
+	TextureStats const & Stats() const { return stats; }
+
+	// Bytes taken by a width x height texture with channels components and a full mip chain from base_level.
+	static size_t MipChainBytes(int width, int height, int channels, int base_level = 0);
+
+private:
+	struct Entry
+	{
+		GLuint id;
+		std::string source;
+		int width;			// full resolution
+		int height;
+		int channels;
+		int baseLevel;		// 0 when fully resident, n when the top n mips are evicted
+		size_t bytes;
+		unsigned lastUsedFrame;
+		bool live;
+		std::list<Handle>::iterator lruPos;
+	};
+
+	TextureCache & cache;
+	std::vector<Entry> entries;
+	std::vector<Handle> freeHandles;
+	std::list<Handle> lru;		// front = least recently used
+	unsigned frame;
+	TextureStats stats;
+
+	bool upload(Entry & entry, int base_level);
+	void touch(Handle handle);
+	void enforceBudget();
+	int minResidentLevel(Entry const & entry) const;
+};
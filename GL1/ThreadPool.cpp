@@ -0,0 +1,140 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace
+{
+	thread_local int currentWorker = -1;
+}
+
+ThreadPool::ThreadPool(unsigned thread_count)
+	: queued(0), unfinished(0), nextQueue(0), stopping(false)
+{
+	thread_count = std::max(1u, thread_count);
+	for (unsigned i(0); i < thread_count; ++i)
+		queues.emplace_back(new Queue());
+	for (unsigned i(0); i < thread_count; ++i)
+		threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	WaitIdle();
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread & t : threads)
+		t.join();
+}
+
+int ThreadPool::WorkerIndex()
+{
+	return currentWorker;
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	// Tasks spawned by a worker stay on its own deque (cache-warm); others are spread round-robin
+	unsigned target = (currentWorker >= 0 && currentWorker < static_cast<int>(queues.size()))
+		? static_cast<unsigned>(currentWorker)
+		: nextQueue.fetch_add(1, std::memory_order_relaxed) % Size();
+	// Counted before it is pushed: once in the deque it can be taken, run and counted off at once,
+	// and counting it after that would let unfinished reach 0 while other tasks still run
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		++unfinished;
+		queued.fetch_add(1, std::memory_order_release);
+	}
+	{
+		std::lock_guard<std::mutex> guard(queues[target]->lock);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> guard(sleepLock);
+	idle.wait(guard, [this]() { return unfinished == 0; });
+}
+
+void ThreadPool::ParallelFor(unsigned count, std::function<void(unsigned)> const & body)
+{
+	struct Batch
+	{
+		std::atomic<unsigned> next;
+		std::atomic<unsigned> done;
+		std::mutex lock;
+		std::condition_variable finished;
+	};
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->next = 0;
+	batch->done = 0;
+
+	// Helpers that start after every index is taken return without touching body
+	std::function<void(unsigned)> const * work = &body;
+	auto run = [batch, count, work]() {
+		for (unsigned i; (i = batch->next.fetch_add(1)) < count; ) {
+			(*work)(i);
+			if (batch->done.fetch_add(1) + 1 == count) {
+				std::lock_guard<std::mutex> guard(batch->lock);
+				batch->finished.notify_all();
+			}
+		}
+	};
+	unsigned helpers = std::min(count > 0 ? count - 1 : 0, Size());
+	for (unsigned i(0); i < helpers; ++i)
+		Submit(run);
+	run();
+
+	std::unique_lock<std::mutex> guard(batch->lock);
+	batch->finished.wait(guard, [&]() { return batch->done.load() == count; });
+}
+
+bool ThreadPool::takeTask(unsigned index, std::function<void()> & task)
+{
+	// Own deque first, newest task
+	{
+		Queue & own = *queues[index];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	// Then steal the oldest task of another worker
+	for (unsigned offset(1); offset < Size(); ++offset) {
+		Queue & victim = *queues[(index + offset) % Size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+	currentWorker = static_cast<int>(index);
+	std::function<void()> task;
+	for (;;) {
+		if (takeTask(index, task)) {
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			task();
+			task = nullptr;
+			std::lock_guard<std::mutex> guard(sleepLock);
+			if (--unfinished == 0)
+				idle.notify_all();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+		if (stopping && queued.load(std::memory_order_acquire) == 0)
+			return;
+	}
+}
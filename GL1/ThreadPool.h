@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. Workers run their own tasks
+// newest first and steal the oldest tasks of other workers when they run dry.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned thread_count = std::thread::hardware_concurrency());
+	~ThreadPool();	// finishes every queued task, then joins
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool & operator=(ThreadPool const &) = delete;
+
+	unsigned Size() const { return static_cast<unsigned>(queues.size()); }
+
+	void Submit(std::function<void()> task);
+
+	template <class F>
+	auto Async(F f) -> std::future<decltype(f())>
+	{
+		auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+		std::future<decltype(f())> result = task->get_future();
+		Submit([task]() { (*task)(); });
+		return result;
+	}
+
+	// Blocks until every task submitted so far has finished
+	void WaitIdle();
+
+	// Runs body(i) for every i in [0, count) on the workers and the calling thread, returning
+	// once all have finished. The caller takes indices itself instead of just waiting, so this
+	// is safe to call from inside a pool task.
+	void ParallelFor(unsigned count, std::function<void(unsigned)> const & body);
+
+	// Index of the calling worker thread, or -1 outside the pool
+	static int WorkerIndex();
+
+private:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::atomic<unsigned> queued;		// tasks sitting in a deque
+	unsigned unfinished;				// queued + running, guarded by sleepLock
+	std::atomic<unsigned> nextQueue;
+	bool stopping;
+
+	void workerLoop(unsigned index);
+	bool takeTask(unsigned index, std::function<void()> & task);
+};
@@ -0,0 +1,161 @@
+#include "TileCache.h"
+#include <algorithm>
+#include <cmath>
+
+TileCache::TileCache()
+	: width(0), height(0), tileSize(1), mipCount(0), slotsX(0), slotsY(0), frame(0), indirectionDirty(false)
+{
+}
+
+TileCache::TileCache(int width, int height, int tile_size, int slots_x, int slots_y)
+	: width(width), height(height), tileSize(tile_size), mipCount(1), slotsX(slots_x), slotsY(slots_y), frame(0), indirectionDirty(true)
+{
+	// Mips go down until the whole level fits in a single tile
+	while (PagesX(mipCount - 1) > 1 || PagesY(mipCount - 1) > 1)
+		++mipCount;
+
+	Slot empty = { 0, 0, false, false };
+	slots.assign(static_cast<size_t>(slotsX) * slotsY, empty);
+
+	// Pin the coarsest page into slot 0 right away; it is uploaded with the first Resolve()
+	uint32_t top = MakePageKey(mipCount - 1, 0, 0);
+	slots[0].page = top;
+	slots[0].used = true;
+	slots[0].pinned = true;
+	pending.push_back(top);
+}
+
+int TileCache::PagesX(int mip) const
+{
+	int w = std::max(1, width >> mip);
+	return (w + tileSize - 1) / tileSize;
+}
+
+int TileCache::PagesY(int mip) const
+{
+	int h = std::max(1, height >> mip);
+	return (h + tileSize - 1) / tileSize;
+}
+
+void TileCache::CollectFootprint(float u0, float v0, float u1, float v1, int mip, std::vector<uint32_t> & pages) const
+{
+	mip = std::min(std::max(mip, 0), mipCount - 1);
+	int pagesX = PagesX(mip), pagesY = PagesY(mip);
+	// Page coordinates are relative to the texels of this mip, which may not fill the last page
+	float texelsToPagesX = static_cast<float>(std::max(1, width >> mip)) / tileSize;
+	float texelsToPagesY = static_cast<float>(std::max(1, height >> mip)) / tileSize;
+	int x0 = std::max(0, static_cast<int>(std::floor(std::min(u0, u1) * texelsToPagesX)));
+	int x1 = std::min(pagesX - 1, static_cast<int>(std::floor(std::max(u0, u1) * texelsToPagesX)));
+	int y0 = std::max(0, static_cast<int>(std::floor(std::min(v0, v1) * texelsToPagesY)));
+	int y1 = std::min(pagesY - 1, static_cast<int>(std::floor(std::max(v0, v1) * texelsToPagesY)));
+	for (int y(y0); y <= y1; ++y)
+		for (int x(x0); x <= x1; ++x)
+			pages.push_back(MakePageKey(mip, x, y));
+}
+
+void TileCache::BeginFrame()
+{
+	++frame;
+}
+
+void TileCache::Request(uint32_t page)
+{
+	++stats.requests;
+	auto it = resident.find(page);
+	if (it != resident.end()) {
+		++stats.hits;
+		slots[it->second].lastUsed = frame;
+		return;
+	}
+	pending.push_back(page);
+}
+
+int TileCache::findVictim() const
+{
+	int victim = -1;
+	for (int i(0); i < static_cast<int>(slots.size()); ++i) {
+		Slot const & slot = slots[i];
+		if (slot.pinned)
+			continue;
+		if (!slot.used)
+			return i;
+		if (slot.lastUsed != frame && (victim < 0 || slot.lastUsed < slots[victim].lastUsed))
+			victim = i;
+	}
+	return victim;
+}
+
+std::vector<TileUpload> const & TileCache::Resolve(size_t max_uploads)
+{
+	uploads.clear();
+	// Coarser pages first: they cover more of the screen and are the fallback for finer ones.
+	// The mip sits in the top byte, so a descending key sort does exactly that.
+	std::sort(pending.begin(), pending.end(), [](uint32_t a, uint32_t b) { return a > b; });
+	pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+	size_t next = 0;
+	for (; next < pending.size() && uploads.size() < max_uploads; ++next) {
+		uint32_t page = pending[next];
+		int slot;
+		if (slots[0].pinned && slots[0].page == page && resident.find(page) == resident.end()) {
+			slot = 0;
+		}
+		else {
+			slot = findVictim();
+			if (slot < 0) {
+				stats.dropped += static_cast<unsigned>(pending.size() - next);
+				next = pending.size();
+				break;
+			}
+			if (slots[slot].used) {
+				resident.erase(slots[slot].page);
+				++stats.evictions;
+			}
+		}
+		slots[slot].page = page;
+		slots[slot].used = true;
+		slots[slot].lastUsed = frame;
+		resident[page] = slot;
+		TileUpload upload = { page, slot };
+		uploads.push_back(upload);
+	}
+	// Whatever didn't fit this frame gets requested again by the next footprint pass
+	pending.clear();
+
+	stats.uploads += static_cast<unsigned>(uploads.size());
+	if (!uploads.empty())
+		indirectionDirty = true;
+	return uploads;
+}
+
+int TileCache::Lookup(uint32_t page) const
+{
+	auto it = resident.find(page);
+	return it == resident.end() ? -1 : it->second;
+}
+
+bool TileCache::BuildIndirection(std::vector<uint32_t> & entries)
+{
+	if (!indirectionDirty)
+		return false;
+	indirectionDirty = false;
+
+	int pagesX = PagesX(0), pagesY = PagesY(0);
+	entries.assign(static_cast<size_t>(pagesX) * pagesY, 0);
+	for (int y(0); y < pagesY; ++y) {
+		for (int x(0); x < pagesX; ++x) {
+			for (int mip(0); mip < mipCount; ++mip) {
+				int px = std::min(x >> mip, PagesX(mip) - 1);
+				int py = std::min(y >> mip, PagesY(mip) - 1);
+				int slot = Lookup(MakePageKey(mip, px, py));
+				if (slot < 0)
+					continue;
+				uint32_t sx = static_cast<uint32_t>(slot % slotsX), sy = static_cast<uint32_t>(slot / slotsX);
+				// little-endian RGBA8: r = slot x, g = slot y, b = mip, a = 255
+				entries[static_cast<size_t>(y) * pagesX + x] = sx | (sy << 8) | (static_cast<uint32_t>(mip) << 16) | 0xff000000u;
+				break;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Virtual page address: mip level and page coordinates at that level, packed into 32 bits
+inline uint32_t MakePageKey(int mip, int x, int y) { return (static_cast<uint32_t>(mip) << 24) | (static_cast<uint32_t>(y) << 12) | static_cast<uint32_t>(x); }
+inline int PageMip(uint32_t key) { return static_cast<int>(key >> 24); }
+inline int PageX(uint32_t key) { return static_cast<int>(key & 0xfff); }
+inline int PageY(uint32_t key) { return static_cast<int>((key >> 12) & 0xfff); }
+
+// A page that has to be streamed into a physical slot
+struct TileUpload
+{
+	uint32_t page;
+	int slot;
+};
+
+struct TileCacheStats
+{
+	unsigned requests;
+	unsigned hits;
+	unsigned uploads;
+	unsigned evictions;
+	unsigned dropped;	// requests left unserved because every slot was in use this frame
+
+	TileCacheStats() : requests(0), hits(0), uploads(0), evictions(0), dropped(0) {}
+};
+
+// CPU side of a virtual texture: maps virtual pages of a width x height image (split into
+// tile_size tiles per mip) onto a fixed number of physical cache slots, evicting the least
+// recently requested page when the cache is full. No GL in here.
+class TileCache
+{
+public:
+	TileCache();
+	TileCache(int width, int height, int tile_size, int slots_x, int slots_y);
+
+	int MipCount() const { return mipCount; }
+	int PagesX(int mip) const;
+	int PagesY(int mip) const;
+	int SlotsX() const { return slotsX; }
+	int SlotsY() const { return slotsY; }
+	int TileSize() const { return tileSize; }
+
+	// Appends every page of the given mip touched by the UV rectangle [u0,u1] x [v0,v1].
+	void CollectFootprint(float u0, float v0, float u1, float v1, int mip, std::vector<uint32_t> & pages) const;
+
+	// Starts a new frame of requests; pages requested in the current frame are never evicted.
+	void BeginFrame();
+	void Request(uint32_t page);
+	// Assigns slots to the requested pages that are not resident, up to max_uploads of them.
+	// The caller must fill each returned slot with its page's texels.
+	std::vector<TileUpload> const & Resolve(size_t max_uploads);
+
+	// Resident slot of a page, or -1
+	int Lookup(uint32_t page) const;
+
+	// One RGBA8 entry per mip-0 page: (slot x, slot y, mip, 255) of the finest resident page covering it.
+	// Returns false when nothing changed since the previous call.
+	bool BuildIndirection(std::vector<uint32_t> & entries);
+
+	TileCacheStats const & Stats() const { return stats; }
+
+private:
+	struct Slot
+	{
+		uint32_t page;
+		unsigned lastUsed;
+		bool used;
+		bool pinned;	// the coarsest mip is always resident, so every lookup has a fallback
+	};
+
+	int width, height, tileSize;
+	int mipCount;
+	int slotsX, slotsY;
+	unsigned frame;
+	bool indirectionDirty;
+	std::vector<Slot> slots;
+	std::unordered_map<uint32_t, int> resident;		// page -> slot
+	std::vector<uint32_t> pending;					// requested this frame but not resident
+	std::vector<TileUpload> uploads;
+	TileCacheStats stats;
+
+	int findVictim() const;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Hands the newest value from one producer thread to one consumer thread: the producer fills
+// WriteBuffer() and publishes it, the consumer picks up the latest published value with Acquire()
+// and may read it until its next Acquire(). The slots change hands through one atomic exchange,
+// so neither side ever waits for the other to finish with a slot; values published faster than
+// they are picked up are overwritten. Three slots, so one can be written and one read while a
+// third holds the value in between. Slots are reused, so containers in T keep their capacity
+// from one value to the next. A consumer with nothing to do can sleep in WaitAcquire().
+template <class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : writeIndex(0), ready(1), readIndex(2), waiting(false), woken(false) {}
+	TripleBuffer(TripleBuffer const &) = delete;
+	TripleBuffer & operator=(TripleBuffer const &) = delete;
+
+	// Producer
+	T & WriteBuffer() { return slots[writeIndex]; }
+	void Publish()
+	{
+		writeIndex = ready.exchange(writeIndex | FRESH) & INDEX_MASK;
+		// Only touches the lock when the consumer is asleep (or about to be)
+		if (waiting.load())
+			signal(false);
+	}
+
+	// Consumer. False, with ReadBuffer() unchanged, when nothing was published since the last call.
+	bool Acquire()
+	{
+		if ((ready.load(std::memory_order_relaxed) & FRESH) == 0)
+			return false;
+		readIndex = ready.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+	// Like Acquire(), but sleeps until something is published or Wake() is called
+	bool WaitAcquire()
+	{
+		if (Acquire())
+			return true;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			// waiting is seen by any Publish() whose value this check misses
+			waiting.store(true);
+			published.wait(guard, [this] { return woken || (ready.load() & FRESH) != 0; });
+			waiting.store(false);
+			woken = false;
+		}
+		return Acquire();
+	}
+	T const & ReadBuffer() const { return slots[readIndex]; }
+
+	// Any thread: ends the consumer's current (or next) WaitAcquire() without a new value
+	void Wake() { signal(true); }
+
+private:
+	enum { INDEX_MASK = 3, FRESH = 4 };
+
+	T slots[3];
+	unsigned writeIndex;			// producer only
+	std::atomic<unsigned> ready;	// slot between the two, FRESH when published and not yet acquired
+	unsigned readIndex;				// consumer only
+
+	std::mutex lock;
+	std::condition_variable published;
+	std::atomic<bool> waiting;		// the consumer is in WaitAcquire()
+	bool woken;						// guarded by lock
+
+	void signal(bool wake)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		woken = woken || wake;
+		published.notify_one();
+	}
+};
@@ -0,0 +1,208 @@
+#include "VirtualTexture.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "ImageUtils.h"
+#include "stb_image.h"
+
+namespace
+{
+	// Tile file layout: header, then for every mip (finest first) its pages row by row,
+	// each page (tileSize + 2 * border)^2 RGBA8 texels.
+	uint32_t const TILE_MAGIC = 0x454c5456;	// "VTLE"
+	uint32_t const TILE_VERSION = 1;
+	int const TILE_BORDER = 1;				// keeps bilinear filtering inside the page
+
+	struct TileFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		int32_t width;
+		int32_t height;
+		int32_t tileSize;
+		int32_t border;
+	};
+
+	// Copies one page of a mip (with its border, clamped at the image edges) into tile
+	void extractTile(unsigned char const * mip, int width, int height, int tile_size, int border, int page_x, int page_y, unsigned char * tile)
+	{
+		int side = tile_size + 2 * border;
+		for (int ty(0); ty < side; ++ty) {
+			int sy = std::min(std::max(page_y * tile_size + ty - border, 0), height - 1);
+			for (int tx(0); tx < side; ++tx) {
+				int sx = std::min(std::max(page_x * tile_size + tx - border, 0), width - 1);
+				std::memcpy(tile + (static_cast<size_t>(ty) * side + tx) * 4, mip + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+			}
+		}
+	}
+}
+
+VirtualTexture::VirtualTexture()
+	: width(0), height(0), tileSize(0), border(0), tileBytes(0), cacheTex(0), indirectionTex(0)
+{
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	Release();
+}
+
+bool VirtualTexture::BuildTileFile(char const * img_name, int tile_size, char const * tile_file)
+{
+	int w, h, channels;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char * img = stbi_load(img_name, &w, &h, &channels, 4);
+	if (img == NULL)
+		return false;
+
+	FILE * f = std::fopen(tile_file, "wb");
+	if (f == NULL) {
+		stbi_image_free(img);
+		return false;
+	}
+	TileFileHeader header = { TILE_MAGIC, TILE_VERSION, w, h, tile_size, TILE_BORDER };
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+
+	TileCache layout(w, h, tile_size, 1, 1);
+	int side = tile_size + 2 * TILE_BORDER;
+	std::vector<unsigned char> tile(static_cast<size_t>(side) * side * 4);
+	std::vector<unsigned char> mips[2];
+	unsigned char const * mip = img;
+	int mipW = w, mipH = h;
+	for (int level(0); ok && level < layout.MipCount(); ++level) {
+		if (level > 0) {
+			HalveImage(mip, mipW, mipH, 4, mips[level & 1]);
+			mip = mips[level & 1].data();
+			mipW = std::max(1, mipW / 2);
+			mipH = std::max(1, mipH / 2);
+		}
+		for (int py(0); ok && py < layout.PagesY(level); ++py) {
+			for (int px(0); ok && px < layout.PagesX(level); ++px) {
+				extractTile(mip, mipW, mipH, tile_size, TILE_BORDER, px, py, tile.data());
+				ok = std::fwrite(tile.data(), 1, tile.size(), f) == tile.size();
+			}
+		}
+	}
+	ok = std::fclose(f) == 0 && ok;
+	stbi_image_free(img);
+	if (!ok)
+		std::remove(tile_file);
+	return ok;
+}
+
+bool VirtualTexture::Open(char const * tile_file, int slots_x, int slots_y)
+{
+	Release();
+	if (!tiles.Open(tile_file) || tiles.Size() < sizeof(TileFileHeader))
+		return false;
+	TileFileHeader header;
+	std::memcpy(&header, tiles.Data(), sizeof(header));
+	if (header.magic != TILE_MAGIC || header.version != TILE_VERSION || header.tileSize <= 0 || header.width <= 0 || header.height <= 0) {
+		tiles.Close();
+		return false;
+	}
+
+	width = header.width;
+	height = header.height;
+	tileSize = header.tileSize;
+	border = header.border;
+	int side = tileSize + 2 * border;
+	tileBytes = static_cast<size_t>(side) * side * 4;
+	slots_x = std::min(std::max(slots_x, 1), 256);
+	slots_y = std::min(std::max(slots_y, 1), 256);
+	cache = TileCache(width, height, tileSize, slots_x, slots_y);
+
+	size_t tileCount = 0;
+	mipFirstTile.resize(cache.MipCount());
+	for (int mip(0); mip < cache.MipCount(); ++mip) {
+		mipFirstTile[mip] = tileCount;
+		tileCount += static_cast<size_t>(cache.PagesX(mip)) * cache.PagesY(mip);
+	}
+	if (tiles.Size() != sizeof(TileFileHeader) + tileCount * tileBytes) {
+		tiles.Close();
+		return false;
+	}
+
+	// Physical cache: a grid of slots, no mips (filtering stays inside the tile borders)
+	glGenTextures(1, &cacheTex);
+	glBindTexture(GL_TEXTURE_2D, cacheTex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, slots_x * side, slots_y * side, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	// Indirection: one texel per mip-0 page
+	glGenTextures(1, &indirectionTex);
+	glBindTexture(GL_TEXTURE_2D, indirectionTex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cache.PagesX(0), cache.PagesY(0), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Bring in the pinned coarsest page so there is always something to sample
+	Update(0.0f, 0.0f, 0.0f, 0.0f, static_cast<float>(1 << (cache.MipCount() - 1)));
+	return true;
+}
+
+void VirtualTexture::Release()
+{
+	if (cacheTex != 0)
+		glDeleteTextures(1, &cacheTex);
+	if (indirectionTex != 0)
+		glDeleteTextures(1, &indirectionTex);
+	cacheTex = indirectionTex = 0;
+	tiles.Close();
+}
+
+unsigned char const * VirtualTexture::tileData(uint32_t page) const
+{
+	int mip = PageMip(page);
+	size_t index = mipFirstTile[mip] + static_cast<size_t>(PageY(page)) * cache.PagesX(mip) + PageX(page);
+	return tiles.Data() + sizeof(TileFileHeader) + index * tileBytes;
+}
+
+void VirtualTexture::Update(float u0, float v0, float u1, float v1, float texels_per_pixel, size_t max_uploads)
+{
+	if (!tiles.IsOpen())
+		return;
+
+	int mip = static_cast<int>(std::floor(std::log2(std::max(texels_per_pixel, 1.0f))));
+	std::vector<uint32_t> pages;
+	cache.CollectFootprint(u0, v0, u1, v1, mip, pages);
+	cache.BeginFrame();
+	for (uint32_t page : pages)
+		cache.Request(page);
+
+	std::vector<TileUpload> const & uploads = cache.Resolve(max_uploads);
+	if (!uploads.empty()) {
+		int side = tileSize + 2 * border;
+		glBindTexture(GL_TEXTURE_2D, cacheTex);
+		for (TileUpload const & upload : uploads) {
+			int sx = upload.slot % cache.SlotsX(), sy = upload.slot / cache.SlotsX();
+			glTexSubImage2D(GL_TEXTURE_2D, 0, sx * side, sy * side, side, side, GL_RGBA, GL_UNSIGNED_BYTE, tileData(upload.page));
+		}
+	}
+	if (cache.BuildIndirection(indirection)) {
+		glBindTexture(GL_TEXTURE_2D, indirectionTex);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, cache.PagesX(0), cache.PagesY(0), GL_RGBA, GL_UNSIGNED_BYTE, indirection.data());
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VirtualTexture::Bind(Shader & shader, unsigned cache_unit, unsigned indirection_unit)
+{
+	glActiveTexture(GL_TEXTURE0 + cache_unit);
+	glBindTexture(GL_TEXTURE_2D, cacheTex);
+	glActiveTexture(GL_TEXTURE0 + indirection_unit);
+	glBindTexture(GL_TEXTURE_2D, indirectionTex);
+	shader.setUniform1i("vtCache", static_cast<int>(cache_unit));
+	shader.setUniform1i("vtIndirection", static_cast<int>(indirection_unit));
+	shader.setUniform2f("vtSize", static_cast<float>(width), static_cast<float>(height));
+	shader.setUniform2f("vtSlots", static_cast<float>(cache.SlotsX()), static_cast<float>(cache.SlotsY()));
+	shader.setUniform1f("vtTileSize", static_cast<float>(tileSize));
+	shader.setUniform1f("vtBorder", static_cast<float>(border));
+}
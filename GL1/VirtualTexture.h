@@ -0,0 +1,51 @@
+#pragma once
+#include <GLAD/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "MappedFile.h"
+#include "Shader.h"
+#include "TileCache.h"
+
+// Sparse texture for images too large to keep resident. The source image is split offline
+// (BuildTileFile) into fixed-size tiles for every mip; at runtime only the tiles touched by the
+// current UV footprint are streamed from the mapped tile file into a physical cache texture,
+// and an indirection texture tells the shader (virtual_tex.fs) where each page lives.
+// Works best with power-of-two image sizes, where pages of successive mips nest exactly.
+class VirtualTexture
+{
+public:
+	VirtualTexture();
+	~VirtualTexture();
+	VirtualTexture(VirtualTexture const &) = delete;
+	VirtualTexture & operator=(VirtualTexture const &) = delete;
+
+	// Decodes img_name and writes every mip as tile_size tiles (plus a 1 texel border) into tile_file.
+	static bool BuildTileFile(char const * img_name, int tile_size, char const * tile_file);
+
+	// Maps tile_file and creates a cache of slots_x * slots_y tiles (at most 256 x 256).
+	bool Open(char const * tile_file, int slots_x, int slots_y);
+	void Release();	// must run while the GL context is still current
+
+	// CPU-side feedback: requests the pages inside the visible UV rectangle at the mip that puts
+	// texels_per_pixel mip-0 texels on one screen pixel, then streams in up to max_uploads tiles.
+	void Update(float u0, float v0, float u1, float v1, float texels_per_pixel, size_t max_uploads = 16);
+
+	// Binds the cache and indirection textures and sets the sampling uniforms of virtual_tex.fs.
+	void Bind(Shader & shader, unsigned cache_unit = 0, unsigned indirection_unit = 1);
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	TileCache const & Cache() const { return cache; }
+
+private:
+	MappedFile tiles;
+	TileCache cache;
+	int width, height, tileSize, border;
+	size_t tileBytes;
+	std::vector<size_t> mipFirstTile;	// index of the first tile of each mip in the file
+	std::vector<uint32_t> indirection;
+	GLuint cacheTex, indirectionTex;
+
+	unsigned char const * tileData(uint32_t page) const;
+};
@@ -4,22 +4,45 @@
 #include <fstream>
 #include <chrono>    
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "stb_image.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "AnimatedTexture.h"
 #include "Camera.h"
+#include "FixedTimestep.h"
+#include "ImageIndex.h"
+#include "ImageLoader.h"
 #include "Shader.h"
+#include "TextureCache.h"
+#include "TextureManager.h"
+#include "TripleBuffer.h"
+#include "VirtualTexture.h"
 
 // Constants
 float const WINDOW_WIDTH(1920);
 float const WINDOW_HEIGHT(1080);
+size_t const TEXTURE_BUDGET_BYTES(256u << 20);
+char const * const IMAGE_INDEX_FILE("texindex.bin");
+unsigned const SIM_STEPS_PER_SECOND(120);
+float const CUBE_BOUNDING_RADIUS(0.52f);	// half the diagonal of the 0.6 cube
+char const * const VIRTUAL_TEXTURE_IMAGE("wall.jpg");
+char const * const VIRTUAL_TEXTURE_TILES("wall.vtiles");	// built from the image on the first run
+int const VIRTUAL_TEXTURE_TILE_SIZE(64);
+float const VIRTUAL_CUBE_SCALE(3.0f);
+char const * const ANIMATED_IMAGE("bounce.gif");
+
+// glClipControl is GL 4.5 / ARB_clip_control, beyond the GL 3.3 loader
+typedef void (APIENTRYP ClipControlProc)(GLenum origin, GLenum depth);
+#ifndef GL_ZERO_TO_ONE
+#define GL_ZERO_TO_ONE 0x935F
+#endif
 
 // Callbacks
-void framebufferSizeCallback(GLFWwindow* window, int width, int height)
-{
-	glViewport(100, 100, width - 200, height - 200);
-}
+void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 
@@ -30,7 +53,29 @@ struct init_res
 	char const * err_str;
 	GLFWwindow * window;
 	int return_code;
-	init_res() : err_str("not modified after initialization"), window(NULL), return_code(-1) {};
+	bool reverseDepth;	// depth cleared to 0 and tested with GL_GEQUAL
+	init_res() : err_str("not modified after initialization"), window(NULL), return_code(-1), reverseDepth(false) {};
+};
+
+// Everything the render thread needs for one frame. Built by the main thread, then only read.
+struct FramePacket
+{
+	uint64_t number;					// 1 for the first packet, one more for each after it
+	double time;						// simulated seconds
+	unsigned cameraVersion;				// Camera::Version() of the matrices below
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 viewPos;
+	int viewportWidth, viewportHeight;
+	glm::vec3 lightPos;
+	glm::mat4 lightModel;
+	std::vector<glm::mat4> cubeModels;	// the cubes in view
+	bool virtualCubeVisible;
+	glm::mat4 virtualCubeModel;
+	float virtualTexelsPerPixel;		// mip-0 texels of the virtual texture on one screen pixel
+	bool animatedCubeVisible;
+	glm::mat4 animatedCubeModel;
+	int debugPower;
 };
 
 init_res init(void)
@@ -62,17 +107,31 @@ init_res init(void)
 		return res;
 	}
 
-	// Viewport
-	glViewport(100, 100, 1720, 880);
+	// Viewport, from the framebuffer's real size (not the window's on high-DPI screens)
+	int fbWidth, fbHeight;
+	glfwGetFramebufferSize(res.window, &fbWidth, &fbHeight);
+	framebufferSizeCallback(res.window, fbWidth, fbHeight);
 
 	// Register callbacks
 	glfwSetFramebufferSizeCallback(res.window, framebufferSizeCallback);
 	glfwSetCursorPosCallback(res.window, mouse_callback);
 	glfwSetScrollCallback(res.window, scroll_callback);
 
-	// Enable depth buffer
+	// Enable depth buffer. With clip control, reverse-Z: depth goes from 1 at the near plane to 0
+	// at infinity, so there is no far plane to clip the scene
 	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LEQUAL);
+	ClipControlProc clipControl = NULL;
+	if (glfwExtensionSupported("GL_ARB_clip_control"))
+		clipControl = (ClipControlProc)glfwGetProcAddress("glClipControl");
+	res.reverseDepth = clipControl != NULL;
+	if (res.reverseDepth) {
+		clipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+		glClearDepth(0.0);
+		glDepthFunc(GL_GEQUAL);
+	}
+	else {
+		glDepthFunc(GL_LEQUAL);
+	}
 
 	// Enable stencil buffer for the outline
 	/*glEnable(GL_STENCIL_TEST);
@@ -99,51 +158,33 @@ void setVisibility(float* visibility, float newAmt)
 	std::cout << "visibility: " << *visibility << std::endl;
 }
 
-void processInput(GLFWwindow *, float *);
-
-bool createTexture(char const * img_name, GLuint texobj_id)
+// Whether a sphere is at least partly inside the side planes of the view frustum, which also
+// leaves out whatever is behind the camera. Near and far are left to the depth test.
+bool sphereInView(glm::mat4 const & view_projection, glm::vec3 const & center, float radius)
 {
-	glBindTexture(GL_TEXTURE_2D, texobj_id);
-	// Set options
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	unsigned char *img_data(NULL);
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true);
-	img_data = stbi_load(img_name, &width, &height, &nrChannels, 0);
-	printf("image \"%s\": width: %d, height: %d, nrChannels: %d", img_name, width, height, nrChannels);
-	if (img_data == NULL) {
-		std::cout << "Fuck. Can't load image \"" << img_name << "\"." << std::endl;
-		return GL_FALSE;
+	for (int side(0); side < 4; ++side) {
+		int axis = side / 2;
+		float sign = (side & 1) ? -1.0f : 1.0f;
+		glm::vec3 normal(view_projection[0][3] + sign * view_projection[0][axis],
+			view_projection[1][3] + sign * view_projection[1][axis],
+			view_projection[2][3] + sign * view_projection[2][axis]);
+		float offset = view_projection[3][3] + sign * view_projection[3][axis];
+		if (glm::dot(normal, center) + offset < -radius * std::sqrt(glm::dot(normal, normal)))
+			return false;
 	}
-
-	// which format?
-	GLint format;
-	char const * r_png = strstr(img_name, ".png");
-	if (r_png != nullptr) {
-		format = GL_RGBA;
-	}
-	else {
-		format = GL_RGB;
-	}
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, img_data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	stbi_image_free(img_data);	// Free the memory of the texture read
-	glBindTexture(GL_TEXTURE_2D, 0);
-	return GL_TRUE;
+	return true;
 }
 
+void processInput(GLFWwindow *, float *, float);
+
 float radius(10.0f);
 float mouseSensitivity(1.0f);
 
 // dangerous global variables
-float deltaTime(0.0f);
 float currMousePosX(WINDOW_WIDTH / 2.0f),	prevMousePosX(WINDOW_WIDTH / 2.0f);
 float currMousePosY(WINDOW_HEIGHT / 2.0f),	prevMousePosY(WINDOW_HEIGHT / 2.0f);
 bool firstEntered = true;
+int viewportWidth(0), viewportHeight(0);	// set by framebufferSizeCallback, drawn with the next packet
 
 // Camera
 Camera cam(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -153,6 +194,9 @@ int DEBUG_power = 32;
 
 int main()
 {
+	// Startup benchmark: time until the first frame is presented (cold vs. warm texture cache)
+	auto t_launch = std::chrono::high_resolution_clock::now();
+
 	// Init
 	init_res res = init();
 	if (res.return_code) {
@@ -160,6 +204,7 @@ int main()
 		return -1;
 	}
 	GLFWwindow * window = res.window;
+	cam.SetDepthRange(0.1f, 100.0f, res.reverseDepth ? Camera::DEPTH_REVERSE_INFINITE : Camera::DEPTH_STANDARD);
 
 	// Read shaders
 	Shader cubeShader("cube_color.vs", "cube_color.fs");
@@ -218,15 +263,52 @@ int main()
 		20,22,23,
 	};
 
-	// Create texture
-	GLuint gorgeousImg;
-	glGenTextures(1, &gorgeousImg);
-	//GLuint gorgeousImgs[2];
-	//glGenTextures(2, gorgeousImgs);
-	// Read texture
-	createTexture("ping.png", gorgeousImg);
-	//createTexture("ping.png", gorgeousImgs[0]);
-	//createTexture("awesomeface.png", gorgeousImgs[1]);
+	// Create texture (decoded pixels come from the texture cache when the file has been seen before).
+	// Large JPEGs with restart markers are decoded across the pool.
+	ThreadPool decodePool;
+	ImageLoader::EnableParallelJpeg(&decodePool);
+	TextureCache textureCache;
+	TextureManager textureManager(textureCache, TEXTURE_BUDGET_BYTES);
+
+	// Every image's size from its header alone, so texture memory is known before any decode.
+	// Only files changed since the last run have their headers read again.
+	ImageIndex imageIndex;
+	{
+		auto t_index = std::chrono::high_resolution_clock::now();
+		ImageIndex previous;
+		previous.Load(IMAGE_INDEX_FILE);
+		if (imageIndex.Build(".", decodePool, &previous))
+			imageIndex.Save(IMAGE_INDEX_FILE);
+		size_t plannedBytes = 0;
+		for (ImageIndexEntry const & entry : imageIndex.Entries())
+			plannedBytes += TextureManager::MipChainBytes(entry.width, entry.height, entry.channels);
+		float index_ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(std::chrono::high_resolution_clock::now() - t_index).count();
+		printf("indexed %zu images in %.2f ms: %.1f MB of textures with mips, budget %.1f MB\n", imageIndex.Entries().size(), index_ms,
+			plannedBytes / 1048576.0, TEXTURE_BUDGET_BYTES / 1048576.0);
+	}
+	auto t_load = std::chrono::high_resolution_clock::now();
+	TextureManager::Handle gorgeousImg = textureManager.Load("ping.png");
+	//TextureManager::Handle gorgeousImgs[2];
+	//gorgeousImgs[0] = textureManager.Load("ping.png");
+	//gorgeousImgs[1] = textureManager.Load("awesomeface.png");
+	float load_ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(std::chrono::high_resolution_clock::now() - t_load).count();
+	printf("textures loaded in %.2f ms\n", load_ms);
+
+	// One texture drawn through the virtual texture page table: only the tiles at the mip the
+	// big cube needs on screen are resident
+	Shader virtualShader("cube_color.vs", "virtual_tex.fs");
+	VirtualTexture virtualTexture;
+	bool haveVirtualTexture = virtualShader.id != -1 && (virtualTexture.Open(VIRTUAL_TEXTURE_TILES, 16, 8)
+		|| (VirtualTexture::BuildTileFile(VIRTUAL_TEXTURE_IMAGE, VIRTUAL_TEXTURE_TILE_SIZE, VIRTUAL_TEXTURE_TILES)
+			&& virtualTexture.Open(VIRTUAL_TEXTURE_TILES, 16, 8)));
+	if (!haveVirtualTexture)
+		printf("virtual texture from %s unavailable\n", VIRTUAL_TEXTURE_IMAGE);
+
+	// An animated GIF on one more cube, decoded a few frames ahead on the pool
+	AnimatedTexture animatedTexture(decodePool);
+	bool haveAnimation = animatedTexture.Open(ANIMATED_IMAGE);
+	if (!haveAnimation)
+		printf("animation %s unavailable\n", ANIMATED_IMAGE);
 
 	// Set Vertex Array Object for the cube
 	GLuint VAO;
@@ -303,125 +385,252 @@ int main()
 	// Light source position
 	glm::vec3 lightSrcPos(1.2f, 1.0f, -2.0f);
 
-	auto t_start = std::chrono::high_resolution_clock::now();
-	float lastTime = 0.0f;
+	// The virtually textured cube, behind the others, and the animated one
+	glm::vec3 virtualCubePos(0.0f, 0.0f, -8.0f);
+	glm::vec3 animatedCubePos(-2.5f, 1.5f, -4.0f);
+
+	// The main thread keeps the window: it polls input, runs the simulation and puts each frame in
+	// a FramePacket. The render thread owns the GL context from here on and draws the packets, so
+	// one frame is prepared while the one before it is being submitted.
+	TripleBuffer<FramePacket> packets;
+	TripleBuffer<TextureStats> renderStats;	// back from the render thread, for the title bar
+	std::atomic<uint64_t> packetsTaken(0);	// number of the packet the render thread last picked up
+	std::atomic<bool> rendering(true);
+	uint64_t packetsPublished = 0;
+
+	// Input and movement run in fixed steps; frames draw the camera between the last two
+	FixedTimestep simClock(SIM_STEPS_PER_SECOND);
+	glm::vec3 camFrom(cam.Position), camTo(cam.Position);	// after the last two steps
 	float visibility(.25f);
 
-	// Render loop
-	while (!glfwWindowShouldClose(window)) {
-
-		// time and delta time
-		auto t_now = std::chrono::high_resolution_clock::now();
-		float time = std::chrono::duration_cast<std::chrono::duration<float>>(t_now - t_start).count();
-		deltaTime = time - lastTime;
-
-		// input
-		processInput(window, &visibility);
-
-		/*	float x = sin(time * 3.0f);
-			float y = sin(time * 2.0f);
-			float z = sin(time * 1.0f);*/
-
-		// rendering
-		//glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // Teal color
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f); // Black color
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	auto publishPacket = [&]() {
+		cam.SetPosition(glm::mix(camFrom, camTo, static_cast<float>(simClock.Alpha())));
+		glm::mat4 const & viewProjection = cam.GetViewProjectionMatrix();
+
+		FramePacket & packet = packets.WriteBuffer();
+		packet.number = ++packetsPublished;
+		packet.time = simClock.Seconds();	// in double, so angles stay exact however long it runs
+		packet.cameraVersion = cam.Version();
+		packet.view = cam.GetViewMatrix();
+		packet.projection = cam.GetProjectionMatrix();
+		packet.viewPos = cam.Position;
+		packet.viewportWidth = viewportWidth;
+		packet.viewportHeight = viewportHeight;
+		packet.lightPos = lightSrcPos;
+		packet.lightModel = glm::translate(glm::mat4(1.0f), lightSrcPos);
+		packet.lightModel = glm::scale(packet.lightModel, glm::vec3(0.25f)); // a smaller cube
+		packet.debugPower = DEBUG_power;
+
+		// Every face shows the whole texture, so the footprint is all of it, at the mip for the
+		// cube's size on screen from its nearest point
+		float virtualRadius = CUBE_BOUNDING_RADIUS * VIRTUAL_CUBE_SCALE;
+		packet.virtualCubeVisible = haveVirtualTexture && sphereInView(viewProjection, virtualCubePos, virtualRadius);
+		packet.virtualCubeModel = glm::scale(glm::translate(glm::mat4(1.0f), virtualCubePos), glm::vec3(VIRTUAL_CUBE_SCALE));
+		if (packet.virtualCubeVisible) {
+			float distance = std::max(glm::length(virtualCubePos - cam.Position) - virtualRadius, 0.1f);
+			float sidePixels = 0.6f * VIRTUAL_CUBE_SCALE * packet.projection[1][1] * 0.5f * std::max(viewportHeight, 1) / distance;
+			packet.virtualTexelsPerPixel = std::max(virtualTexture.Width(), virtualTexture.Height()) / std::max(sidePixels, 1.0f);
+		}
 
-		// The cubes will be written onto the stencil buffer. 
-		glStencilFunc(GL_ALWAYS, 1, 0xFF); // all fragments should pass the stencil test
-		glStencilMask(0xFF);	// all fragments update the stencil buffer
+		packet.animatedCubeVisible = haveAnimation && sphereInView(viewProjection, animatedCubePos, CUBE_BOUNDING_RADIUS);
+		packet.animatedCubeModel = glm::translate(glm::mat4(1.0f), animatedCubePos);
+		float animatedDegrees = static_cast<float>(std::fmod(packet.time * 20.0, 360.0));
+		packet.animatedCubeModel = glm::rotate(packet.animatedCubeModel, glm::radians(animatedDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
 
-		// Cube
-		cubeShader.use();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gorgeousImg);
-		glBindVertexArray(VAO);
+		// The slot's vector keeps its capacity, so after the first few packets this doesn't allocate
+		packet.cubeModels.clear();
+		int len = sizeof(cube_positions) / sizeof(cube_positions[0]);
+		for (int i(0); i < len; ++i) {
+			if (!sphereInView(viewProjection, cube_positions[i], CUBE_BOUNDING_RADIUS))
+				continue;
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), cube_positions[i]);
+			float degrees = static_cast<float>(std::fmod(packet.time * -55.0 * (i + 1), 360.0));
+			model = glm::rotate(model, glm::radians(degrees), glm::vec3(1.0f * i, 0.5f*(i + 1), 0.25f*(i + 2)));
+			packet.cubeModels.push_back(model);
+		}
+		packets.Publish();
+	};
 
-		// Set lightSrcPos
-		cubeShader.setUniformVec3f("lightSrcPos", lightSrcPos);
+	// The first packet is there before the render thread starts, so it never waits on an empty buffer
+	publishPacket();
+	glfwMakeContextCurrent(NULL);
+
+	std::thread renderThread([&]() {
+		glfwMakeContextCurrent(window);
+		bool firstFrame = true;
+		double lastStatsTime = 0.0;
+		unsigned cameraVersion = 0;	// of the matrices last given to the shaders
+		int viewport[2] = { -1, -1 };
+		double animationTime = 0.0;	// simulated time the animation has been advanced to
+
+		// Render loop
+		while (rendering.load(std::memory_order_acquire)) {
+			// Sleeps while the main thread has nothing new, e.g. minimized or between input events
+			if (!packets.WaitAcquire())
+				continue;
+			FramePacket const & packet = packets.ReadBuffer();
+			packetsTaken.store(packet.number, std::memory_order_release);
+			glfwPostEmptyEvent();	// wakes the main thread to build the next one while this one is drawn
+
+			if (packet.viewportWidth != viewport[0] || packet.viewportHeight != viewport[1]) {
+				glViewport(100, 100, packet.viewportWidth, packet.viewportHeight);
+				viewport[0] = packet.viewportWidth;
+				viewport[1] = packet.viewportHeight;
+			}
+
+			// rendering
+			//glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // Teal color
+			glClearColor(0.1f, 0.1f, 0.1f, 1.0f); // Black color
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+			// The cubes will be written onto the stencil buffer. 
+			glStencilFunc(GL_ALWAYS, 1, 0xFF); // all fragments should pass the stencil test
+			glStencilMask(0xFF);	// all fragments update the stencil buffer
+
+			// Cube
+			cubeShader.use();
+			textureManager.Bind(gorgeousImg, 0);
+			glBindVertexArray(VAO);
+
+			// Set lightSrcPos
+			cubeShader.setUniformVec3f("lightSrcPos", packet.lightPos);
+
+			// DEBUG_REMOVE
+			cubeShader.setUniform1f("DEBUG_power", static_cast<float>(packet.debugPower));
+
+			// The programs keep their uniforms, so the camera's are only set again after it has
+			// moved, turned or zoomed
+			bool cameraChanged = packet.cameraVersion != cameraVersion;
+			if (cameraChanged) {
+				cubeShader.setUniformVec3f("viewPos", packet.viewPos);
+				cubeShader.setUniformMat4f("view", packet.view);
+				cubeShader.setUniformMat4f("projection", packet.projection);
+			}
+
+			for (glm::mat4 const & model : packet.cubeModels) {
+				cubeShader.setUniformMat4f("model", model);
+				glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+			}
+
+			// The animation plays on in simulated time, on screen or not; only the changed part of
+			// each frame that came due is uploaded
+			if (haveAnimation) {
+				animatedTexture.Update((packet.time - animationTime) * 1000.0);
+				animationTime = packet.time;
+			}
+			if (packet.animatedCubeVisible) {
+				animatedTexture.Bind(0);
+				cubeShader.setUniformMat4f("model", packet.animatedCubeModel);
+				glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+			}
+
+			// Virtually textured cube: stream in the tiles it needs, then draw with the page table
+			if (packet.virtualCubeVisible) {
+				virtualTexture.Update(0.0f, 0.0f, 1.0f, 1.0f, packet.virtualTexelsPerPixel);
+				virtualShader.use();
+				virtualTexture.Bind(virtualShader, 1, 2);
+				if (cameraChanged) {
+					virtualShader.setUniformMat4f("view", packet.view);
+					virtualShader.setUniformMat4f("projection", packet.projection);
+				}
+				virtualShader.setUniformMat4f("model", packet.virtualCubeModel);
+				glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+			}
+
+			//// Draw cube outlines
+			//// First disable writting to the stencil buffer
+			//glStencilFunc(GL_NOTEQUAL, 1, 0xFF);	// only those != 1 should pass the stencil test
+			//glStencilMask(0x00);	// no updating
+			//glDisable(GL_DEPTH_TEST);
+			//// Then we do the cubes scaled up
+			//outlineShader.use();
+			//glBindVertexArray(VAO);
+			//for (glm::mat4 const & model : packet.cubeModels) {
+			//	cubeShader.setUniformMat4f("model", glm::scale(model, glm::vec3(1.1f, 1.1f, 1.1f)));
+			//	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+			//}
+			//glBindVertexArray(0);
+			//glStencilMask(0xFF);
+			//glStencilFunc(GL_ALWAYS, 0, 0xFF);
+			//glEnable(GL_DEPTH_TEST);
+
+			// Draw light src
+			glStencilMask(0x00);
+			lightSrcShader.use();
+			if (cameraChanged) {
+				lightSrcShader.setUniformMat4f("projection", packet.projection);
+				lightSrcShader.setUniformMat4f("view", packet.view);
+				cameraVersion = packet.cameraVersion;
+			}
+			lightSrcShader.setUniformMat4f("model", packet.lightModel);
+
+			glBindVertexArray(lightSrcVAO);
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 
-		// Set viewPos
-		cubeShader.setUniformVec3f("viewPos", cam.Position);
-		// DEBUG_REMOVE
-		cubeShader.setUniform1f("DEBUG_power", static_cast<float>(DEBUG_power));
+			// Keep textures within budget; the main thread shows the stats in the title bar
+			textureManager.EndFrame();
+			if (packet.time - lastStatsTime >= 1.0) {
+				renderStats.WriteBuffer() = textureManager.Stats();
+				renderStats.Publish();
+				lastStatsTime = packet.time;
+			}
+
+			glfwSwapBuffers(window);
+
+			if (firstFrame) {
+				float startup_ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(std::chrono::high_resolution_clock::now() - t_launch).count();
+				printf("startup: first frame after %.2f ms\n", startup_ms);
+				firstFrame = false;
+			}
+		}
 
+		// Textures have to go while the context is still alive
+		animatedTexture.Release();
+		virtualTexture.Release();
+		textureManager.ReleaseAll();
+		glfwMakeContextCurrent(NULL);
+	});
 
-		glm::mat4 view = glm::mat4(1.0f);
-		view = cam.GetViewMatrix();
-		cubeShader.setUniformMat4f("view", view);
-	
-		glm::mat4 projection;
-		float r_angle = 90.0f * std::abs(std::sin(time));
-		projection = glm::perspective(glm::radians(cam.Zoom), WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 100.0f);
-		cubeShader.setUniformMat4f("projection", projection);
-	
-		glm::mat4 model;
-		int modelLoc;
-		int len = sizeof(cube_positions) / sizeof(cube_positions[0]);
-		for (int i(0); i < len; ++i) {
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, cube_positions[i]);
-			model = glm::rotate(model, time * glm::radians(-55.0f*(i + 1)), glm::vec3(1.0f * i, 0.5f*(i + 1), 0.25f*(i + 2)));
-			cubeShader.setUniformMat4f("model", model);
-			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+	// Event and simulation loop
+	while (!glfwWindowShouldClose(window)) {
+		// Sleeps until input arrives, a step comes due or the render thread takes the last packet
+		glfwWaitEventsTimeout(simClock.StepSeconds());
+
+		// simulation: the steps that came due since the last time round
+		unsigned steps = simClock.Advance();
+		for (unsigned i(0); i < steps; ++i) {
+			cam.SetPosition(camTo);
+			processInput(window, &visibility, static_cast<float>(simClock.StepSeconds()));
+			camFrom = camTo;
+			camTo = cam.Position;
 		}
 
-		//// Draw cube outlines
-		//// First disable writting to the stencil buffer
-		//glStencilFunc(GL_NOTEQUAL, 1, 0xFF);	// only those != 1 should pass the stencil test
-		//glStencilMask(0x00);	// no updating
-		//glDisable(GL_DEPTH_TEST);
-		//// Then we do the cubes scaled up
-		//outlineShader.use();
-		//glBindVertexArray(VAO);
-		//view = glm::mat4(1.0f);
-		//view = cam.GetViewMatrix();
-		//cubeShader.setUniformMat4f("view", view);
-		//r_angle = 90.0f * std::abs(std::sin(time));
-		//projection = glm::perspective(glm::radians(cam.Zoom), WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 100.0f);
-		//cubeShader.setUniformMat4f("projection", projection);
-		//len = sizeof(cube_positions) / sizeof(cube_positions[0]);
-		//for (int i(0); i < len; ++i) {
-		//	model = glm::mat4(1.0f);
-		//	model = glm::translate(model, cube_positions[i]);
-		//	model = glm::rotate(model, time * glm::radians(-55.0f*(i + 1)), glm::vec3(1.0f * i, 0.5f*(i + 1), 0.25f*(i + 2)));
-		//	model = glm::scale(model, glm::vec3(1.1f, 1.1f, 1.1f));
-		//	cubeShader.setUniformMat4f("model", model);
-		//	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-		//}
-		//glBindVertexArray(0);
-		//glStencilMask(0xFF);
-		//glStencilFunc(GL_ALWAYS, 0, 0xFF);
-		//glEnable(GL_DEPTH_TEST);
-
-		// Draw light src
-		glStencilMask(0x00);
-		lightSrcShader.use();
-		lightSrcShader.setUniformMat4f("projection", projection);
-		lightSrcShader.setUniformMat4f("view", view);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, lightSrcPos);
-		model = glm::scale(model, glm::vec3(0.25f)); // a smaller cube
-		lightSrcShader.setUniformMat4f("model", model);
-
-		glBindVertexArray(lightSrcVAO);
-		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-		// check and call events and swap the buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
-
-		// last time
-		lastTime = time;
+		// The next packet once the render thread has taken the last one, so it is built while that
+		// one is drawn. Any sooner and it would only replace a packet that was never drawn.
+		if (packetsTaken.load(std::memory_order_acquire) == packetsPublished)
+			publishPacket();
+
+		if (renderStats.Acquire()) {
+			TextureStats const & ts = renderStats.ReadBuffer();
+			char title[256];
+			snprintf(title, sizeof(title), "Clarence's awesome game | textures: %zu, %.1f / %.1f MB, evictions: %u, stream-ins: %u (last %.2f ms, avg %.2f ms)",
+				ts.textureCount, ts.residentBytes / 1048576.0, ts.budgetBytes / 1048576.0, ts.evictions, ts.streamIns, ts.lastStreamInMs, ts.AvgStreamInMs());
+			glfwSetWindowTitle(window, title);
+		}
 	}
 
+	rendering.store(false, std::memory_order_release);
+	packets.Wake();
+	renderThread.join();
+	ImageLoader::EnableParallelJpeg(nullptr);
 
 	// !!! Never forget this
 	glfwTerminate();
 	return 0;
 }
 
-void processInput(GLFWwindow *window, float * visibility)
+// Runs once per simulation step, deltaTime long
+void processInput(GLFWwindow *window, float * visibility, float deltaTime)
 {
 	int altL = glfwGetKey(window, GLFW_KEY_LEFT_ALT);
 	int altR = glfwGetKey(window, GLFW_KEY_RIGHT_ALT);
@@ -515,6 +724,15 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 	cam.UpdateZoom(static_cast<float>(yoffset));
 }
 
+// Keeps a 100 pixel border on every side; the projection follows the viewport's aspect ratio.
+// Runs on the main thread, so glViewport is left to the render thread, with the first packet of the new size.
+void framebufferSizeCallback(GLFWwindow* window, int width, int height)
+{
+	viewportWidth = width - 200;
+	viewportHeight = height - 200;
+	cam.SetViewportSize(viewportWidth, viewportHeight);
+}
+
 //void read_shader(char const *  shader_name, char * shader_text, size_t shader_text_max_len)
 //{
 //	// shader_text must be length of 0!
@@ -1,2 +1,12 @@
+#include "DecodeArena.h"
+
+// Decoder allocations go to the calling thread's arena while a DecodeArena::Scope is active.
+// Every block these return, heap fallbacks included, starts 16 bytes after a DecodeArena header,
+// so anything stb_image hands out (pixels, the GIF delays array, ...) must be released with
+// stbi_image_free. Passing it to free() corrupts the heap.
+#define STBI_MALLOC(sz)           DecodeArena::Malloc(sz)
+#define STBI_REALLOC(p,newsz)     DecodeArena::Realloc(p,newsz)
+#define STBI_FREE(p)              DecodeArena::Free(p)
+
 #define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
\ No newline at end of file
+#include "stb_image.h"
@@ -401,7 +401,39 @@ extern "C" {
 
 #ifndef STBI_NO_GIF
 	STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
-#endif
+
+	// animated GIFs one frame at a time, in the same memory however many frames there are.
+	// each call composites the next frame into dest (x * y * req_comp bytes, rows dest_stride
+	// apart, 0 = packed), whole and flipped if flipping was on when the stream was opened, or
+	// as set for the stream -- decode threads can then leave their own flip setting alone.
+	// rect gets the part that differs from the frame before -- x, y, w, h in dest's rows --
+	// which is all a texture already holding that frame needs. buffer must outlive the stream.
+	// next returns 1 for a frame, 0 past the last one and -1 on a corrupt file; rewind goes
+	// back to the first frame
+	typedef struct stbi__gif_stream stbi_gif_stream;
+	STBIDEF stbi_gif_stream *stbi_gif_stream_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y);
+	STBIDEF void     stbi_gif_stream_set_flip_vertically(stbi_gif_stream *gs, int flag_true_if_should_flip);
+	STBIDEF int      stbi_gif_stream_next(stbi_gif_stream *gs, stbi_uc *dest, int dest_stride, int req_comp, int *delay_ms, int rect[4]);
+	STBIDEF int      stbi_gif_stream_rewind(stbi_gif_stream *gs);
+	STBIDEF void     stbi_gif_stream_close(stbi_gif_stream *gs);
+#endif
+
+	// decode into memory you provide (a mapped buffer object, a pooled staging
+	// area, ...) instead of a fresh allocation. rows of x * desired_channels bytes
+	// go dest_stride bytes apart (0 = tightly packed) and must fit in dest_size
+	// bytes; get the size from stbi_info_from_memory first. desired_channels is
+	// required. PNG and JPEG decode straight into dest; other formats are copied
+	// in from a temporary. the flip setting applies as usual. returns 1 on success
+	STBIDEF int      stbi_load_into_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels,
+	                                            stbi_uc *dest, int dest_stride, size_t dest_size);
+
+	// the same through callbacks, for data that arrives over time. rows (may be NULL) is
+	// told as rows of dest are finished: baseline JPEGs, and 8-bit PNGs that decode straight
+	// into dest, report bands while the rest of the file is still being read; other images
+	// report every row once at the end. with flipping on, bands fill dest from the bottom
+	typedef void stbi_rows_callback(void *user, int first_row, int row_count);
+	STBIDEF int      stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels,
+	                                               stbi_uc *dest, int dest_stride, size_t dest_size, stbi_rows_callback *rows, void *rows_user);
 
 #ifdef STBI_WINDOWS_UTF8
 	STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
@@ -492,6 +524,56 @@ extern "C" {
 	// calling it will fail to link if your compiler doesn't
 	STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+	// decode JPEGs at 1/2, 1/4 or 1/8 of their size (pass 2, 4 or 8; 1 is full size)
+	// using reduced IDCTs, which is much cheaper than decoding and downsampling.
+	// the returned width and height are the reduced ones, rounded up; stbi_info
+	// still reports the full size. other formats are not affected
+	STBIDEF void stbi_set_jpeg_scale_denom(int denom);
+
+	// as above, but only for images loaded on the calling thread; like the flip
+	// setting, this needs compiler support for thread-local variables
+	STBIDEF void stbi_set_jpeg_scale_denom_thread(int denom);
+
+	// multiply the color channels of PNGs and TGAs by their alpha while they are
+	// decoded, for premultiplied-alpha blending; tRNS transparency and palettes are
+	// covered too. iPhone PNGs are stored premultiplied and are returned as they are,
+	// whatever stbi_set_unpremultiply_on_load says. other formats are not affected
+	STBIDEF void stbi_set_premultiply_on_load(int flag_true_if_should_premultiply);
+
+	// as above, but only for images loaded on the calling thread
+	STBIDEF void stbi_set_premultiply_on_load_thread(int flag_true_if_should_premultiply);
+
+	// the JPEG and PNG decoders use AVX2 kernels when the CPU supports them; pass
+	// 0 to force the SSE2 kernels instead (mainly useful for benchmarking)
+	STBIDEF void stbi_set_avx2_enabled(int flag_true_if_should_use_avx2);
+
+	// JPEGs with restart markers can have their restart intervals decoded in
+	// parallel. install a function that calls task(task_data, i) for every i in
+	// [0, count), on whatever threads it likes, and returns once all of them have
+	// finished. only images decoded from memory are split up; everything else,
+	// and every image when func is NULL, is decoded serially
+	typedef void stbi_parallel_task(void *task_data, int index);
+	typedef void stbi_parallel_for(void *user, int count, stbi_parallel_task *task, void *task_data);
+	STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for *func, void *user);
+
+	// time the stages of decodes on the calling thread, for benchmarking. clock returns
+	// the current time in any unit; the time spent in each phase is added to totals,
+	// an array of STBI_PHASE_COUNT. only JPEG and PNG decoding are broken down (a
+	// baseline JPEG's IDCT runs block by block inside its entropy decode and counts
+	// there); channel conversion and flipping are timed for every format, and headers
+	// and everything else aren't counted at all. pass NULL to stop. needs thread-local
+	// variables, like stbi_set_flip_vertically_on_load_thread
+	enum
+	{
+		STBI_PHASE_ENTROPY,     // Huffman decoding, inflate
+		STBI_PHASE_TRANSFORM,   // progressive JPEG IDCT, PNG unfiltering
+		STBI_PHASE_COLOR,       // JPEG upsampling and YCbCr, PNG palettes and tRNS, req_comp
+		STBI_PHASE_FLIP,        // flips that weren't folded into the decode
+		STBI_PHASE_COUNT
+	};
+	typedef double stbi_phase_clock(void);
+	STBIDEF void stbi_set_phase_timer_thread(stbi_phase_clock *clock, double *totals);
+
 	// ZLIB client - used by PNG, available for other purposes
 
 	STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -611,12 +693,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -718,7 +802,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
 	int info3 = stbi__cpuid3();
@@ -729,7 +813,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
 	// If we're even attempting to compile this on GCC/Clang, that means
@@ -742,6 +826,89 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are compiled per-function and picked at runtime, so the rest of
+// the library still only requires SSE2
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG))
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define STBI__AVX2
+#define STBI__AVX2_TARGET
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define STBI__AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef STBI__AVX2
+#include <immintrin.h>
+#ifndef _MSC_VER
+#include <cpuid.h>
+#endif
+
+// both flags are shared by every decoding thread, so they are only touched through these
+#ifdef _MSC_VER
+typedef long stbi__avx2_flag;
+#define stbi__avx2_load(p)               _InterlockedOr((p), 0)
+#define stbi__avx2_store(p, v)           _InterlockedExchange((p), (v))
+#define stbi__avx2_claim(p, from, to)    (_InterlockedCompareExchange((p), (to), (from)) == (from))
+#else
+typedef int stbi__avx2_flag;
+#define stbi__avx2_load(p)               __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define stbi__avx2_store(p, v)           __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define stbi__avx2_claim(p, from, to)    stbi__avx2_cas((p), (from), (to))
+static int stbi__avx2_cas(stbi__avx2_flag *p, int from, int to)
+{
+	return __atomic_compare_exchange_n(p, &from, to, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+static stbi__avx2_flag stbi__avx2_enabled = 1;
+static stbi__avx2_flag stbi__avx2_detected = -1; // -1 not yet, -2 being detected, else the answer
+
+static int stbi__avx2_detect(void)
+{
+	unsigned int features1, features7, xcr0;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return 0;
+	__cpuid(info, 1);
+	features1 = (unsigned int)info[2];
+	__cpuidex(info, 7, 0);
+	features7 = (unsigned int)info[1];
+#else
+	unsigned int a, b, c, d;
+	if (__get_cpuid_max(0, 0) < 7) return 0;
+	__cpuid(1, a, b, c, d);
+	features1 = c;
+	__cpuid_count(7, 0, a, b, c, d);
+	features7 = b;
+#endif
+	// the OS has to have enabled XSAVE and be saving the YMM registers
+	if (!((features1 >> 27) & 1) || !((features1 >> 28) & 1)) return 0;
+#ifdef _MSC_VER
+	xcr0 = (unsigned int)_xgetbv(0);
+#else
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(xcr0), "=d"(d) : "c"(0));
+#endif
+	if ((xcr0 & 6) != 6) return 0;
+	return (features7 >> 5) & 1;
+}
+
+static int stbi__avx2_available(void)
+{
+	// CPUID is slow-ish, so only ask once. the first thread in claims the detection and any
+	// others wait the few hundred cycles it takes
+	int detected = stbi__avx2_load(&stbi__avx2_detected);
+	if (detected == -1 && stbi__avx2_claim(&stbi__avx2_detected, -1, -2)) {
+		detected = stbi__avx2_detect();
+		stbi__avx2_store(&stbi__avx2_detected, detected);
+	}
+	while (detected < 0)
+		detected = stbi__avx2_load(&stbi__avx2_detected);
+	return stbi__avx2_load(&stbi__avx2_enabled) && detected;
+}
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -868,6 +1035,14 @@ typedef struct
 	int bits_per_channel;
 	int num_channels;
 	int channel_order;
+	int flip_vertically; // in: the caller wants the bottom row first
+	int flipped;         // out: the loader already wrote the rows that way
+	stbi_uc *dest;       // in: caller's buffer for 8-bit pixels, or NULL; loaders that
+	int dest_stride;     //     use it return dest itself
+	size_t dest_size;
+	stbi_rows_callback *rows; // in: told about rows of dest as they're finished
+	void *rows_user;
+	int rows_reported;   // out: how many it was told about
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -1081,12 +1256,141 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
-static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
+static int stbi__jpeg_scale_shift_global = 0;
+
+static int stbi__jpeg_scale_shift_for(int denom)
+{
+	return denom >= 8 ? 3 : denom >= 4 ? 2 : denom >= 2 ? 1 : 0;
+}
+
+STBIDEF void stbi_set_jpeg_scale_denom(int denom)
+{
+	stbi__jpeg_scale_shift_global = stbi__jpeg_scale_shift_for(denom);
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_scale_shift  stbi__jpeg_scale_shift_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_shift_local, stbi__jpeg_scale_shift_set;
+
+STBIDEF void stbi_set_jpeg_scale_denom_thread(int denom)
+{
+	stbi__jpeg_scale_shift_local = stbi__jpeg_scale_shift_for(denom);
+	stbi__jpeg_scale_shift_set = 1;
+}
+
+#define stbi__jpeg_scale_shift  (stbi__jpeg_scale_shift_set        \
+                                  ? stbi__jpeg_scale_shift_local   \
+                                  : stbi__jpeg_scale_shift_global)
+#endif // STBI_THREAD_LOCAL
+
+static int stbi__premultiply_on_load_global = 0;
+
+STBIDEF void stbi_set_premultiply_on_load(int flag_true_if_should_premultiply)
+{
+	stbi__premultiply_on_load_global = flag_true_if_should_premultiply;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__premultiply_on_load  stbi__premultiply_on_load_global
+#else
+static STBI_THREAD_LOCAL int stbi__premultiply_on_load_local, stbi__premultiply_on_load_set;
+
+STBIDEF void stbi_set_premultiply_on_load_thread(int flag_true_if_should_premultiply)
+{
+	stbi__premultiply_on_load_local = flag_true_if_should_premultiply;
+	stbi__premultiply_on_load_set = 1;
+}
+
+#define stbi__premultiply_on_load  (stbi__premultiply_on_load_set       \
+                                     ? stbi__premultiply_on_load_local  \
+                                     : stbi__premultiply_on_load_global)
+#endif // STBI_THREAD_LOCAL
+
+STBIDEF void stbi_set_avx2_enabled(int flag_true_if_should_use_avx2)
+{
+#ifdef STBI__AVX2
+	stbi__avx2_store(&stbi__avx2_enabled, flag_true_if_should_use_avx2 != 0);
+#else
+	STBI_NOTUSED(flag_true_if_should_use_avx2);
+#endif
+}
+
+static stbi_parallel_for *stbi__jpeg_parallel_for;
+static void *stbi__jpeg_parallel_user;
+
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for *func, void *user)
+{
+	stbi__jpeg_parallel_for = func;
+	stbi__jpeg_parallel_user = user;
+}
+
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL stbi_phase_clock *stbi__phase_clock;
+static STBI_THREAD_LOCAL double *stbi__phase_totals;
+static STBI_THREAD_LOCAL double stbi__phase_mark;
+static STBI_THREAD_LOCAL int stbi__phase_current = -1;
+
+STBIDEF void stbi_set_phase_timer_thread(stbi_phase_clock *clock, double *totals)
+{
+	stbi__phase_clock = clock;
+	stbi__phase_totals = totals;
+	stbi__phase_current = -1;
+}
+
+// charges the time since the last switch to the phase that was running and starts
+// another (-1 for none); returns the old one so nested phases can hand back to it
+static int stbi__phase_enter(int phase)
+{
+	int previous = stbi__phase_current;
+	double now;
+	if (!stbi__phase_clock) return previous;
+	now = stbi__phase_clock();
+	if (previous >= 0) stbi__phase_totals[previous] += now - stbi__phase_mark;
+	stbi__phase_mark = now;
+	stbi__phase_current = phase;
+	return previous;
+}
+#define stbi__phase_leave(previous)  ((void) stbi__phase_enter(previous))
+#else
+#define stbi__phase_enter(phase)     (-1)
+#define stbi__phase_leave(previous)  ((void) (previous))
+#endif
+
+static void stbi__result_info_init(stbi__result_info *ri)
 {
 	memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
 	ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
 	ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
 	ri->num_channels = 0;
+	ri->flip_vertically = stbi__vertically_flip_on_load;
+}
+
+// reports rows [first, end) of an image of the given height, counted in decode
+// order, as finished in dest
+static void stbi__rows_done(stbi__result_info *ri, int first, int end, int height)
+{
+	if (ri == NULL || ri->rows == NULL || first >= end) return;
+	if (ri->flip_vertically)
+		ri->rows(ri->rows_user, height - end, end - first);
+	else
+		ri->rows(ri->rows_user, first, end - first);
+	ri->rows_reported += end - first;
+}
+
+// the row stride to use for an x by y image with n channels in ri->dest, or 0
+// if it doesn't fit
+static int stbi__dest_stride(stbi__result_info *ri, int x, int y, int n)
+{
+	size_t row = (size_t)x * n;
+	size_t stride = ri->dest_stride ? (size_t)ri->dest_stride : row;
+	if (ri->dest == NULL || x <= 0 || y <= 0 || stride < row) return 0;
+	if (stride * (y - 1) + row > ri->dest_size) return 0;
+	return (int)stride;
+}
+
+static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
+{
 
 #ifndef STBI_NO_JPEG
 	if (stbi__jpeg_test(s)) return stbi__jpeg_load(s, x, y, comp, req_comp, ri);
@@ -1166,6 +1470,7 @@ static void stbi__vertical_flip(void *image, int w, int h, int bytes_per_pixel)
 	size_t bytes_per_row = (size_t)w * bytes_per_pixel;
 	stbi_uc temp[2048];
 	stbi_uc *bytes = (stbi_uc *)image;
+	int phase = stbi__phase_enter(STBI_PHASE_FLIP);
 
 	for (row = 0; row < (h >> 1); row++) {
 		stbi_uc *row0 = bytes + row * bytes_per_row;
@@ -1182,6 +1487,7 @@ static void stbi__vertical_flip(void *image, int w, int h, int bytes_per_pixel)
 			bytes_left -= bytes_copy;
 		}
 	}
+	stbi__phase_leave(phase);
 }
 
 #ifndef STBI_NO_GIF
@@ -1201,7 +1507,9 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
 	stbi__result_info ri;
-	void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+	void *result;
+	stbi__result_info_init(&ri);
+	result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
 
 	if (result == NULL)
 		return NULL;
@@ -1216,7 +1524,7 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
 	// @TODO: move stbi__convert_format to here
 
-	if (stbi__vertically_flip_on_load) {
+	if (ri.flip_vertically && !ri.flipped) {
 		int channels = req_comp ? req_comp : *comp;
 		stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
 	}
@@ -1227,7 +1535,9 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
 	stbi__result_info ri;
-	void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
+	void *result;
+	stbi__result_info_init(&ri);
+	result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
 
 	if (result == NULL)
 		return NULL;
@@ -1243,7 +1553,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
 	// @TODO: move stbi__convert_format16 to here
 	// @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-	if (stbi__vertically_flip_on_load) {
+	if (ri.flip_vertically && !ri.flipped) {
 		int channels = req_comp ? req_comp : *comp;
 		stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
 	}
@@ -1251,6 +1561,55 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
 	return (stbi__uint16 *)result;
 }
 
+static int stbi__load_into(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_stride, size_t dest_size,
+	stbi_rows_callback *rows, void *rows_user)
+{
+	stbi__result_info ri;
+	void *result;
+	int row, stride;
+	size_t row_bytes;
+
+	if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+	if (dest == NULL || dest_stride < 0) return stbi__err("bad dest", "Internal error");
+	stbi__result_info_init(&ri);
+	ri.dest = dest;
+	ri.dest_stride = dest_stride;
+	ri.dest_size = dest_size;
+	ri.rows = rows;
+	ri.rows_user = rows_user;
+	result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+	if (result == NULL)
+		return 0;
+	if (result == dest) {
+		// decoded in place, flipped if asked to
+		if (rows && ri.rows_reported == 0) rows(rows_user, 0, *y);
+		return 1;
+	}
+
+	// otherwise copy it over, narrowing and flipping on the way
+	stride = stbi__dest_stride(&ri, *x, *y, req_comp);
+	if (stride == 0) {
+		STBI_FREE(result);
+		return stbi__err("buffer too small", "Image doesn't fit the destination");
+	}
+	row_bytes = (size_t)*x * req_comp;
+	for (row = 0; row < *y; ++row) {
+		int from = (ri.flip_vertically && !ri.flipped) ? *y - 1 - row : row;
+		stbi_uc *out = dest + (size_t)stride * row;
+		if (ri.bits_per_channel == 16) {
+			stbi__uint16 const *in = (stbi__uint16 const *)result + row_bytes * from;
+			size_t i;
+			for (i = 0; i < row_bytes; ++i)
+				out[i] = (stbi_uc)(in[i] >> 8);
+		}
+		else
+			memcpy(out, (stbi_uc const *)result + row_bytes * from, row_bytes);
+	}
+	STBI_FREE(result);
+	if (rows) rows(rows_user, 0, *y);
+	return 1;
+}
+
 #if !defined(STBI_NO_HDR) && !defined(STBI_NO_LINEAR)
 static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
 {
@@ -1381,6 +1740,21 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
 	return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
 }
 
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_stride, size_t dest_size)
+{
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return stbi__load_into(&s, x, y, comp, req_comp, dest, dest_stride, dest_size, NULL, NULL);
+}
+
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp, stbi_uc *dest, int dest_stride, size_t dest_size,
+	stbi_rows_callback *rows, void *rows_user)
+{
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks *)clbk, user);
+	return stbi__load_into(&s, x, y, comp, req_comp, dest, dest_stride, dest_size, rows, rows_user);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1389,8 +1763,8 @@ STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int *
 	stbi__start_mem(&s, buffer, len);
 
 	result = (unsigned char*)stbi__load_gif_main(&s, delays, x, y, z, comp, req_comp);
-	if (stbi__vertically_flip_on_load) {
-		stbi__vertical_flip_slices(result, *x, *y, *z, *comp);
+	if (stbi__vertically_flip_on_load && result) {
+		stbi__vertical_flip_slices(result, *x, *y, *z, req_comp ? req_comp : *comp);
 	}
 
 	return result;
@@ -1694,10 +2068,140 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
+#ifdef STBI_SSE2
+// SSE2 versions of the common stbi__convert_format cases. each converts the start of a
+// row and returns how many pixels that was; the scalar loop does the rest
+
+// packs the low 3 bytes of each 32-bit lane into the low 12 bytes
+static __m128i stbi__pack_rgb_sse2(__m128i px)
+{
+	// pairs of pixels into 6 bytes at the bottom of each half, then the halves together
+	__m128i y = _mm_or_si128(_mm_and_si128(px, _mm_set_epi32(0, 0xffffff, 0, 0xffffff)),
+		_mm_and_si128(_mm_srli_epi64(px, 8), _mm_set_epi32(0xffff, (int)0xff000000, 0xffff, (int)0xff000000)));
+	return _mm_or_si128(_mm_move_epi64(y), _mm_slli_si128(_mm_unpackhi_epi64(y, _mm_setzero_si128()), 6));
+}
+
+static int stbi__convert_1_3_sse2(stbi_uc *dest, stbi_uc const *src, int count)
+{
+	int i;
+	// every 12-byte group is stored with 16 bytes, so stop short of the end of the row
+	for (i = 0; i + 18 <= count; i += 16) {
+		__m128i g = _mm_loadu_si128((__m128i const *)(src + i));
+		__m128i lo = _mm_unpacklo_epi8(g, g), hi = _mm_unpackhi_epi8(g, g);
+		_mm_storeu_si128((__m128i *)(dest + i * 3 + 0), stbi__pack_rgb_sse2(_mm_unpacklo_epi16(lo, lo)));
+		_mm_storeu_si128((__m128i *)(dest + i * 3 + 12), stbi__pack_rgb_sse2(_mm_unpackhi_epi16(lo, lo)));
+		_mm_storeu_si128((__m128i *)(dest + i * 3 + 24), stbi__pack_rgb_sse2(_mm_unpacklo_epi16(hi, hi)));
+		_mm_storeu_si128((__m128i *)(dest + i * 3 + 36), stbi__pack_rgb_sse2(_mm_unpackhi_epi16(hi, hi)));
+	}
+	return i;
+}
+
+static int stbi__convert_1_4_sse2(stbi_uc *dest, stbi_uc const *src, int count)
+{
+	__m128i ff = _mm_set1_epi8(-1);
+	int i;
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i g = _mm_loadu_si128((__m128i const *)(src + i));
+		__m128i gg = _mm_unpacklo_epi8(g, g), ga = _mm_unpacklo_epi8(g, ff);
+		_mm_storeu_si128((__m128i *)(dest + i * 4 + 0), _mm_unpacklo_epi16(gg, ga));
+		_mm_storeu_si128((__m128i *)(dest + i * 4 + 16), _mm_unpackhi_epi16(gg, ga));
+		gg = _mm_unpackhi_epi8(g, g);
+		ga = _mm_unpackhi_epi8(g, ff);
+		_mm_storeu_si128((__m128i *)(dest + i * 4 + 32), _mm_unpacklo_epi16(gg, ga));
+		_mm_storeu_si128((__m128i *)(dest + i * 4 + 48), _mm_unpackhi_epi16(gg, ga));
+	}
+	return i;
+}
+
+static int stbi__convert_2_4_sse2(stbi_uc *dest, stbi_uc const *src, int count)
+{
+	__m128i zero = _mm_setzero_si128(), low = _mm_set1_epi32(0xff);
+	int i, k;
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i ga = _mm_loadu_si128((__m128i const *)(src + i * 2));
+		for (k = 0; k < 2; ++k) {
+			// 0x0000aagg -> 0xaagggggg
+			__m128i p = k ? _mm_unpackhi_epi16(ga, zero) : _mm_unpacklo_epi16(ga, zero);
+			__m128i g = _mm_and_si128(p, low);
+			__m128i r = _mm_or_si128(_mm_or_si128(g, _mm_slli_epi32(g, 8)), _mm_slli_epi32(g, 16));
+			_mm_storeu_si128((__m128i *)(dest + i * 4 + k * 16), _mm_or_si128(r, _mm_slli_epi32(_mm_srli_epi32(p, 8), 24)));
+		}
+	}
+	return i;
+}
+
+static int stbi__convert_3_4_sse2(stbi_uc *dest, stbi_uc const *src, int count)
+{
+	__m128i alpha = _mm_set1_epi32((int)0xff000000);
+	int i;
+	// 16-byte loads of 12-byte groups, so stop short of the end of the row
+	for (i = 0; i + 6 <= count; i += 4) {
+		__m128i rgb = _mm_loadu_si128((__m128i const *)(src + i * 3));
+		__m128i p01 = _mm_unpacklo_epi32(rgb, _mm_srli_si128(rgb, 3));
+		__m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(rgb, 6), _mm_srli_si128(rgb, 9));
+		_mm_storeu_si128((__m128i *)(dest + i * 4), _mm_or_si128(_mm_unpacklo_epi64(p01, p23), alpha));
+	}
+	return i;
+}
+
+static int stbi__convert_4_3_sse2(stbi_uc *dest, stbi_uc const *src, int count)
+{
+	int i;
+	// every 12-byte group is stored with 16 bytes, so stop short of the end of the row
+	for (i = 0; i + 6 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(dest + i * 3), stbi__pack_rgb_sse2(_mm_loadu_si128((__m128i const *)(src + i * 4))));
+	return i;
+}
+
+// stbi__compute_y of 8 pixels in two registers, as 16-bit lanes
+static __m128i stbi__compute_y8_sse2(__m128i a, __m128i b)
+{
+	__m128i low = _mm_set1_epi32(0xff);
+	__m128i r = _mm_packs_epi32(_mm_and_si128(a, low), _mm_and_si128(b, low));
+	__m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), low), _mm_and_si128(_mm_srli_epi32(b, 8), low));
+	__m128i bl = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), low), _mm_and_si128(_mm_srli_epi32(b, 16), low));
+	// the sum reaches 255 * 256, so it wraps as signed but not as unsigned
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150))),
+		_mm_mullo_epi16(bl, _mm_set1_epi16(29)));
+	return _mm_srli_epi16(sum, 8);
+}
+
+static int stbi__convert_4_1_sse2(stbi_uc *dest, stbi_uc const *src, int count)
+{
+	int i;
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i lo = stbi__compute_y8_sse2(_mm_loadu_si128((__m128i const *)(src + i * 4 + 0)), _mm_loadu_si128((__m128i const *)(src + i * 4 + 16)));
+		__m128i hi = stbi__compute_y8_sse2(_mm_loadu_si128((__m128i const *)(src + i * 4 + 32)), _mm_loadu_si128((__m128i const *)(src + i * 4 + 48)));
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+typedef int stbi__convert_row_kernel(stbi_uc *dest, stbi_uc const *src, int count);
+
+static stbi__convert_row_kernel *stbi__convert_kernel_sse2(int img_n, int req_comp)
+{
+	if (!stbi__sse2_available()) return NULL;
+	switch (img_n * 8 + req_comp) {
+		case 1 * 8 + 3: return stbi__convert_1_3_sse2;
+		case 1 * 8 + 4: return stbi__convert_1_4_sse2;
+		case 2 * 8 + 4: return stbi__convert_2_4_sse2;
+		case 3 * 8 + 4: return stbi__convert_3_4_sse2;
+		case 4 * 8 + 3: return stbi__convert_4_3_sse2;
+		case 4 * 8 + 1: return stbi__convert_4_1_sse2;
+		default: return NULL;
+	}
+}
+#endif
+
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
 	int i, j;
 	unsigned char *good;
+	int phase;
+#ifdef STBI_SSE2
+	stbi__convert_row_kernel *kernel;
+#endif
 
 	if (req_comp == img_n) return data;
 	STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
@@ -1707,13 +2211,26 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
 		STBI_FREE(data);
 		return stbi__errpuc("outofmem", "Out of memory");
 	}
+	phase = stbi__phase_enter(STBI_PHASE_COLOR);
+#ifdef STBI_SSE2
+	kernel = stbi__convert_kernel_sse2(img_n, req_comp);
+#endif
 
 	for (j = 0; j < (int)y; ++j) {
 		unsigned char *src = data + j * x * img_n;
 		unsigned char *dest = good + j * x * req_comp;
+		int done = 0;
+
+	#ifdef STBI_SSE2
+		if (kernel) {
+			done = kernel(dest, src, (int)x);
+			src += done * img_n;
+			dest += done * req_comp;
+		}
+	#endif
 
 	#define STBI__COMBO(a,b)  ((a)*8+(b))
-	#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+	#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=(int)x-1-done; i >= 0; --i, src += a, dest += b)
 		// convert source image with img_n components to one with req_comp components;
 		// avoid switch per pixel, so use switch per scanline and massive macros
 		switch (STBI__COMBO(img_n, req_comp)) {
@@ -1734,6 +2251,7 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
 	#undef STBI__CASE
 	}
 
+	stbi__phase_leave(phase);
 	STBI_FREE(data);
 	return good;
 }
@@ -1753,7 +2271,7 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 #else
 static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-	int i, j;
+	int i, j, phase;
 	stbi__uint16 *good;
 
 	if (req_comp == img_n) return data;
@@ -1764,6 +2282,7 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 		STBI_FREE(data);
 		return (stbi__uint16 *)stbi__errpuc("outofmem", "Out of memory");
 	}
+	phase = stbi__phase_enter(STBI_PHASE_COLOR);
 
 	for (j = 0; j < (int)y; ++j) {
 		stbi__uint16 *src = data + j * x * img_n;
@@ -1791,30 +2310,96 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 	#undef STBI__CASE
 	}
 
+	stbi__phase_leave(phase);
 	STBI_FREE(data);
 	return good;
 }
 #endif
 
+#if defined(STBI_NO_PNG) && defined(STBI_NO_TGA)
+// nothing
+#else
+#ifdef STBI_SSE2
+// premultiplies two RGBA pixels widened to 16 bits; the alpha lanes are multiplied by 255
+// so they come out unchanged
+static __m128i stbi__premultiply2_sse2(__m128i px, int swap_rb)
+{
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i m = _mm_or_si128(_mm_and_si128(a, _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1)), _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(px, m), _mm_set1_epi16(128));
+	t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	if (swap_rb)
+		t = _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+	return t;
+}
+#endif
+
+// multiplies the color channels of count pixels with comp (2 or 4) channels by their
+// alpha, rounded to nearest; swap_rb also turns BGRA into RGBA on the way
+static void stbi__premultiply_alpha(stbi_uc *p, stbi__uint32 count, int comp, int swap_rb)
+{
+	stbi__uint32 i = 0;
+	int k;
+#ifdef STBI_SSE2
+	if (comp == 4 && stbi__sse2_available()) {
+		__m128i zero = _mm_setzero_si128();
+		for (; i + 4 <= count; i += 4) {
+			__m128i px = _mm_loadu_si128((__m128i *)(p + i * 4));
+			__m128i lo = stbi__premultiply2_sse2(_mm_unpacklo_epi8(px, zero), swap_rb);
+			__m128i hi = stbi__premultiply2_sse2(_mm_unpackhi_epi8(px, zero), swap_rb);
+			_mm_storeu_si128((__m128i *)(p + i * 4), _mm_packus_epi16(lo, hi));
+		}
+	}
+#endif
+	for (p += i * comp; i < count; ++i, p += comp) {
+		unsigned int a = p[comp - 1];
+		if (swap_rb) {
+			stbi_uc t = p[0];
+			p[0] = p[2];
+			p[2] = t;
+		}
+		for (k = 0; k < comp - 1; ++k) {
+			unsigned int t = p[k] * a + 128;
+			p[k] = (stbi_uc)((t + (t >> 8)) >> 8);
+		}
+	}
+}
+#endif
+
+#ifndef STBI_NO_PNG
+static void stbi__premultiply_alpha16(stbi__uint16 *p, stbi__uint32 count, int comp)
+{
+	stbi__uint32 i;
+	int k;
+	for (i = 0; i < count; ++i, p += comp) {
+		stbi__uint32 a = p[comp - 1];
+		for (k = 0; k < comp - 1; ++k)
+			p[k] = (stbi__uint16)((p[k] * a + 32767) / 65535);
+	}
+}
+#endif
+
 #ifndef STBI_NO_LINEAR
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
 	int i, k, n;
 	float *output;
+	float color_lut[256], alpha_lut[256];
 	if (!data) return NULL;
 	output = (float *)stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
 	if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+	// there are only 256 inputs, so do the pow() once for each of them
+	for (i = 0; i < 256; ++i) {
+		color_lut[i] = (float)(pow(i / 255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+		alpha_lut[i] = i / 255.0f;
+	}
 	// compute number of non-alpha components
 	if (comp & 1) n = comp; else n = comp - 1;
 	for (i = 0; i < x*y; ++i) {
-		for (k = 0; k < n; ++k) {
-			output[i*comp + k] = (float)(pow(data[i*comp + k] / 255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
-		}
-	}
-	if (n < comp) {
-		for (i = 0; i < x*y; ++i) {
-			output[i*comp + n] = data[i*comp + n] / 255.0f;
-		}
+		for (k = 0; k < n; ++k)
+			output[i*comp + k] = color_lut[data[i*comp + k]];
+		if (n < comp)
+			output[i*comp + n] = alpha_lut[data[i*comp + n]];
 	}
 	STBI_FREE(data);
 	return output;
@@ -1823,16 +2408,89 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 
 #ifndef STBI_NO_HDR
 #define stbi__float2int(x)   ((int) (x))
+
+#ifdef STBI_SSE2
+// log2(x) for positive normal x, to about 1e-7
+static __m128 stbi__log2_ps(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+	__m128 big, t, t2, p;
+	// fold the mantissa into [sqrt(1/2), sqrt(2)) so the series below converges quickly
+	big = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+	m = _mm_sub_ps(m, _mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+	e = _mm_add_ps(e, _mm_and_ps(big, _mm_set1_ps(1.0f)));
+	// log2(m) = 2/ln(2) * atanh(t), t = (m - 1) / (m + 1)
+	t = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_add_ps(m, _mm_set1_ps(1.0f)));
+	t2 = _mm_mul_ps(t, t);
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 5), _mm_mul_ps(t2, _mm_set1_ps(1.0f / 7)));
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 3), _mm_mul_ps(t2, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(t2, p));
+	return _mm_add_ps(e, _mm_mul_ps(_mm_mul_ps(t, _mm_set1_ps(2.88539008f)), p));
+}
+
+// 2^y for y in [-126, 0], to about 1e-7
+static __m128 stbi__exp2_ps(__m128 y)
+{
+	__m128i i = _mm_cvtps_epi32(y); // nearest, so the fraction is in [-0.5, 0.5]
+	__m128 f = _mm_sub_ps(y, _mm_cvtepi32_ps(i));
+	__m128 p = _mm_add_ps(_mm_set1_ps(1.33335581e-3f), _mm_mul_ps(f, _mm_set1_ps(1.54035304e-4f)));
+	p = _mm_add_ps(_mm_set1_ps(9.61812911e-3f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(5.55041087e-2f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(2.40226507e-1f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(6.93147181e-1f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, p));
+	return _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23)));
+}
+
+// one stbi__hdr_to_ldr output byte per lane; alpha lanes are just scaled
+static __m128i stbi__hdr_to_ldr4(__m128 v, __m128 alpha_lanes, __m128 scale, __m128 gamma)
+{
+	// anything at or above 1 ends up at 255, and NaN and non-positive values at 0
+	__m128 x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(v, scale), _mm_set1_ps(1e-30f)), _mm_set1_ps(1.0f));
+	__m128 c = _mm_max_ps(_mm_mul_ps(gamma, stbi__log2_ps(x)), _mm_set1_ps(-126.0f));
+	__m128 a = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+	c = _mm_add_ps(_mm_mul_ps(stbi__exp2_ps(c), _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+	a = _mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+	return _mm_cvttps_epi32(_mm_or_ps(_mm_and_ps(alpha_lanes, a), _mm_andnot_ps(alpha_lanes, c)));
+}
+
+// converts the first multiple of 16 values, returning how many that was
+static int stbi__hdr_to_ldr_simd(stbi_uc *output, float const *data, int count, int comp)
+{
+	static const stbi__uint32 alpha_masks[5][4] = { { 0 }, { 0 }, { 0, ~0u, 0, ~0u }, { 0 }, { 0, 0, 0, ~0u } };
+	__m128 alpha_lanes = _mm_loadu_ps((float const *)alpha_masks[comp]);
+	__m128 scale = _mm_set1_ps(stbi__h2l_scale_i);
+	__m128 gamma = _mm_set1_ps(stbi__h2l_gamma_i);
+	int i;
+	// the approximations assume pow() of something in (0, 1]; leave odd gammas to pow()
+	if (!(stbi__h2l_gamma_i > 0) || !stbi__sse2_available()) return 0;
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i a = stbi__hdr_to_ldr4(_mm_loadu_ps(data + i + 0), alpha_lanes, scale, gamma);
+		__m128i b = stbi__hdr_to_ldr4(_mm_loadu_ps(data + i + 4), alpha_lanes, scale, gamma);
+		__m128i c = stbi__hdr_to_ldr4(_mm_loadu_ps(data + i + 8), alpha_lanes, scale, gamma);
+		__m128i d = stbi__hdr_to_ldr4(_mm_loadu_ps(data + i + 12), alpha_lanes, scale, gamma);
+		_mm_storeu_si128((__m128i *)(output + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+	return i;
+}
+#endif
+
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 {
-	int i, k, n;
+	int i, k, n, start = 0;
 	stbi_uc *output;
 	if (!data) return NULL;
 	output = (stbi_uc *)stbi__malloc_mad3(x, y, comp, 0);
 	if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
 	// compute number of non-alpha components
 	if (comp & 1) n = comp; else n = comp - 1;
-	for (i = 0; i < x*y; ++i) {
+#ifdef STBI_SSE2
+	// whole pixels only, so the scalar loop picks up at a pixel boundary
+	start = stbi__hdr_to_ldr_simd(output, data, x*y*comp - (x*y*comp) % (16 * comp), comp) / comp;
+#endif
+	for (i = start; i < x*y; ++i) {
 		for (k = 0; k < n; ++k) {
 			float z = (float)pow(data[i*comp + k] * stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
 			if (z < 0) z = 0;
@@ -1875,7 +2533,7 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 #ifndef STBI_NO_JPEG
 
 // huffman decoding acceleration
-#define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
+#define FAST_BITS   11 // larger handles more cases; smaller stomps less cache
 
 typedef struct
 {
@@ -1888,6 +2546,19 @@ typedef struct
 	int    delta[17];   // old 'firstsymbol' - old 'firstcode'
 } stbi__huffman;
 
+typedef stbi_uc *(*resample_row_func)(stbi_uc *out, stbi_uc *in0, stbi_uc *in1,
+	int w, int hs);
+
+typedef struct
+{
+	resample_row_func resample;
+	stbi_uc *line0, *line1;
+	int hs, vs;   // expansion factor in each axis
+	int w_lores; // horizontal pixels pre-expansion
+	int ystep;   // how far through vertical expansion we are
+	int ypos;    // which pre-expansion row we're on
+} stbi__resample;
+
 typedef struct
 {
 	stbi__context *s;
@@ -1918,7 +2589,7 @@ typedef struct
 		int      coeff_w, coeff_h; // number of 8x8 coefficient blocks
 	} img_comp[4];
 
-	stbi__uint32   code_buffer; // jpeg entropy-coded buffer
+	stbi__uint64   code_buffer; // jpeg entropy-coded buffer, MSB-aligned
 	int            code_bits;   // number of valid bits
 	unsigned char  marker;      // marker seen while filling entropy buffer
 	int            nomore;      // flag if we saw a marker so must stop
@@ -1935,11 +2606,25 @@ typedef struct
 
 	int scan_n, order[4];
 	int restart_interval, todo;
+	int scale_shift;  // blocks decode to (8 >> scale_shift) pixels square
+
+	// color conversion into the output; when rows are streamed it runs an MCU row
+	// behind the entropy decoder
+	stbi__result_info *ri;
+	int req_comp, out_n, decode_n, is_rgb;
+	stbi_uc *output;
+	size_t out_stride;
+	stbi__uint32 rows_out;
+	stbi__resample res_comp[4];
 
 	// kernels
 	void(*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+	void(*idct_pair_kernel)(stbi_uc *out, int out_stride, short data[128]); // NULL if there's no faster way
 	void(*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
 	stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+	stbi_uc *(*resample_row_v_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+	stbi_uc *(*resample_row_h_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+	stbi_uc *(*resample_row_generic_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
 
 static int stbi__build_huffman(stbi__huffman *h, int *count)
@@ -2013,6 +2698,24 @@ static void stbi__build_fast_ac(stbi__int16 *fast_ac, stbi__huffman *h)
 
 static void stbi__grow_buffer_unsafe(stbi__jpeg *j)
 {
+	// fast path: when the next bytes are sitting in the buffer and none of them
+	// is 0xff (a marker or a stuffed zero), top up the bit buffer in one go
+	int n = (63 - j->code_bits) >> 3;
+	if (!j->nomore && j->code_bits >= 0 && n > 0 && j->s->img_buffer_end - j->s->img_buffer >= 8) {
+		stbi_uc *p = j->s->img_buffer;
+		stbi__uint64 v = ((stbi__uint64)p[0] << 56) | ((stbi__uint64)p[1] << 48) | ((stbi__uint64)p[2] << 40) | ((stbi__uint64)p[3] << 32) |
+			((stbi__uint64)p[4] << 24) | ((stbi__uint64)p[5] << 16) | ((stbi__uint64)p[6] << 8) | (stbi__uint64)p[7];
+		stbi__uint64 inv;
+		v &= ~(~(stbi__uint64)0 >> (n * 8)); // only the bytes we'll take
+		inv = ~v;
+		if (!((inv - 0x0101010101010101ull) & ~inv & 0x8080808080808080ull)) {
+			j->code_buffer |= v >> j->code_bits;
+			j->code_bits += n * 8;
+			j->s->img_buffer += n;
+			return;
+		}
+	}
+
 	do {
 		unsigned int b = j->nomore ? 0 : stbi__get8(j->s);
 		if (b == 0xff) {
@@ -2024,9 +2727,9 @@ static void stbi__grow_buffer_unsafe(stbi__jpeg *j)
 				return;
 			}
 		}
-		j->code_buffer |= b << (24 - j->code_bits);
+		j->code_buffer |= (stbi__uint64)b << (56 - j->code_bits);
 		j->code_bits += 8;
-	} while (j->code_bits <= 24);
+	} while (j->code_bits <= 56);
 }
 
 // (1 << n) - 1
@@ -2042,7 +2745,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
 
 	// look at the top FAST_BITS and determine what symbol ID it is,
 	// if the code is <= FAST_BITS
-	c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS) - 1);
+	c = (int)(j->code_buffer >> (64 - FAST_BITS));
 	k = h->fast[c];
 	if (k < 255) {
 		int s = h->size[k];
@@ -2059,7 +2762,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
 	// end; in other words, regardless of the number of bits, it
 	// wants to be compared against something shifted to have 16;
 	// that way we don't need to shift inside the loop.
-	temp = j->code_buffer >> 16;
+	temp = (unsigned int)(j->code_buffer >> 48);
 	for (k = FAST_BITS + 1; ; ++k)
 		if (temp < h->maxcode[k])
 			break;
@@ -2073,8 +2776,8 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg *j, stbi__huffman *h)
 		return -1;
 
 	// convert the huffman code to the symbol id
-	c = ((j->code_buffer >> (32 - k)) & stbi__bmask[k]) + h->delta[k];
-	STBI_ASSERT((((j->code_buffer) >> (32 - h->size[c])) & stbi__bmask[h->size[c]]) == h->code[c]);
+	c = (int)(j->code_buffer >> (64 - k)) + h->delta[k];
+	STBI_ASSERT((j->code_buffer >> (64 - h->size[c])) == h->code[c]);
 
 	// convert the id to a symbol
 	j->code_bits -= k;
@@ -2091,13 +2794,12 @@ stbi_inline static int stbi__extend_receive(stbi__jpeg *j, int n)
 {
 	unsigned int k;
 	int sgn;
+	if (n <= 0 || n >= (int)(sizeof(stbi__bmask) / sizeof(*stbi__bmask))) return 0;
 	if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
 
-	sgn = (stbi__int32)j->code_buffer >> 31; // sign bit is always in MSB
-	k = stbi_lrot(j->code_buffer, n);
-	if (n < 0 || n >= (int)(sizeof(stbi__bmask) / sizeof(*stbi__bmask))) return 0;
-	j->code_buffer = k & ~stbi__bmask[n];
-	k &= stbi__bmask[n];
+	sgn = (stbi__int32)(j->code_buffer >> 32) >> 31; // sign bit is always in MSB
+	k = (unsigned int)(j->code_buffer >> (64 - n));
+	j->code_buffer <<= n;
 	j->code_bits -= n;
 	return k + (stbi__jbias[n] & ~sgn);
 }
@@ -2106,22 +2808,22 @@ stbi_inline static int stbi__extend_receive(stbi__jpeg *j, int n)
 stbi_inline static int stbi__jpeg_get_bits(stbi__jpeg *j, int n)
 {
 	unsigned int k;
+	if (n <= 0) return 0;
 	if (j->code_bits < n) stbi__grow_buffer_unsafe(j);
-	k = stbi_lrot(j->code_buffer, n);
-	j->code_buffer = k & ~stbi__bmask[n];
-	k &= stbi__bmask[n];
+	k = (unsigned int)(j->code_buffer >> (64 - n));
+	j->code_buffer <<= n;
 	j->code_bits -= n;
 	return k;
 }
 
 stbi_inline static int stbi__jpeg_get_bit(stbi__jpeg *j)
 {
-	unsigned int k;
+	int k;
 	if (j->code_bits < 1) stbi__grow_buffer_unsafe(j);
-	k = j->code_buffer;
+	k = (int)(j->code_buffer >> 63);
 	j->code_buffer <<= 1;
 	--j->code_bits;
-	return k & 0x80000000;
+	return k;
 }
 
 // given a value that's at position X in the zigzag stream,
@@ -2165,7 +2867,7 @@ static int stbi__jpeg_decode_block(stbi__jpeg *j, short data[64], stbi__huffman
 		unsigned int zig;
 		int c, r, s;
 		if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-		c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS) - 1);
+		c = (int)(j->code_buffer >> (64 - FAST_BITS));
 		r = fac[c];
 		if (r) { // fast-AC path
 			k += (r >> 4) & 15; // run
@@ -2243,7 +2945,7 @@ static int stbi__jpeg_decode_block_prog_ac(stbi__jpeg *j, short data[64], stbi__
 			unsigned int zig;
 			int c, r, s;
 			if (j->code_bits < 16) stbi__grow_buffer_unsafe(j);
-			c = (j->code_buffer >> (32 - FAST_BITS)) & ((1 << FAST_BITS) - 1);
+			c = (int)(j->code_buffer >> (64 - FAST_BITS));
 			r = fac[c];
 			if (r) { // fast-AC path
 				k += (r >> 4) & 15; // run
@@ -2463,6 +3165,62 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
 	}
 }
 
+// reduced-size IDCTs for scaled decoding: the N-point IDCT of the lowest N
+// coefficients in each direction, normalized like the 8-point one so a flat
+// block keeps its level
+#define STBI__IDCT_4(s0,s1,s2,s3) \
+	int e0 = ((s0) + (s2)) * stbi__f2f(0.707106781f), e1 = ((s0) - (s2)) * stbi__f2f(0.707106781f); \
+	int o0 = (s1) * stbi__f2f(0.923879533f) + (s3) * stbi__f2f(0.382683433f);  \
+	int o1 = (s1) * stbi__f2f(0.382683433f) - (s3) * stbi__f2f(0.923879533f);  \
+	int t0 = e0 + o0, t3 = e0 - o0, t1 = e1 + o1, t2 = e1 - o1
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+	int i, tmp[16];
+	// rows, keeping 2 fractional bits
+	for (i = 0; i < 4; ++i) {
+		short *d = data + i * 8;
+		STBI__IDCT_4(d[0], d[1], d[2], d[3]);
+		tmp[i * 4 + 0] = (t0 + (1 << 9)) >> 10;
+		tmp[i * 4 + 1] = (t1 + (1 << 9)) >> 10;
+		tmp[i * 4 + 2] = (t2 + (1 << 9)) >> 10;
+		tmp[i * 4 + 3] = (t3 + (1 << 9)) >> 10;
+	}
+	// columns: the two 1/2 factors, the fractional bits and the table scale all
+	// come off in one shift, together with the rounding and the +128 level shift
+	for (i = 0; i < 4; ++i) {
+		int *c = tmp + i;
+		STBI__IDCT_4(c[0], c[4], c[8], c[12]);
+		t0 += (128 << 16) + (1 << 15);
+		t1 += (128 << 16) + (1 << 15);
+		t2 += (128 << 16) + (1 << 15);
+		t3 += (128 << 16) + (1 << 15);
+		out[i] = stbi__clamp(t0 >> 16);
+		out[out_stride + i] = stbi__clamp(t1 >> 16);
+		out[out_stride * 2 + i] = stbi__clamp(t2 >> 16);
+		out[out_stride * 3 + i] = stbi__clamp(t3 >> 16);
+	}
+}
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+	// with two points both coefficients are weighted by 1/sqrt(2) twice over,
+	// so this is just sums and differences divided by 8
+	int a = data[0] + data[1], b = data[0] - data[1];
+	int c = data[8] + data[9], d = data[8] - data[9];
+	out[0] = stbi__clamp(((a + c + 4) >> 3) + 128);
+	out[1] = stbi__clamp(((b + d + 4) >> 3) + 128);
+	out[out_stride] = stbi__clamp(((a - c + 4) >> 3) + 128);
+	out[out_stride + 1] = stbi__clamp(((b - d + 4) >> 3) + 128);
+}
+
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+	// the DC term alone is the block average
+	STBI_NOTUSED(out_stride);
+	out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2644,19 +3402,193 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
-#ifdef STBI_NEON
-
-// NEON integer IDCT. should produce bit-identical
-// results to the generic C version.
-static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
+#ifdef STBI__AVX2
+// two horizontally adjacent blocks at once: block 0 (data[0..63]) goes to out, block 1
+// (data[64..127]) to out + 8. every AVX2 instruction used here works within 128-bit lanes,
+// so this is stbi__idct_simd run on block 0 in the low lanes and on block 1 in the high
+// lanes, and just as bit-identical to the generic C version.
+static STBI__AVX2_TARGET void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[128])
 {
-	int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+	__m256i row0, row1, row2, row3, row4, row5, row6, row7;
+	__m256i tmp;
 
-	int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
-	int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
-	int16x4_t rot0_2 = vdup_n_s16(stbi__f2f(0.765366865f));
-	int16x4_t rot1_0 = vdup_n_s16(stbi__f2f(1.175875602f));
-	int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
+#define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+#define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+#define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+#define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+#define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+#define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+	// row r of block 0 in the low lane, row r of block 1 in the high lane
+#define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (data + (r) * 8))), \
+                              _mm_loadu_si128((const __m128i *) (data + 64 + (r) * 8)), 1)
+
+	// low 8 bytes of each lane are row a of the two blocks, high 8 bytes row b
+#define dct_store2(p) \
+      tmp = _mm256_permute4x64_epi64(p, 0xd8); \
+      _mm_storeu_si128((__m128i *) out, _mm256_castsi256_si128(tmp)); out += out_stride; \
+      _mm_storeu_si128((__m128i *) out, _mm256_extracti128_si256(tmp, 1)); out += out_stride
+
+	__m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+	__m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f(0.765366865f), stbi__f2f(0.5411961f));
+	__m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+	__m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+	__m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f(0.298631336f), stbi__f2f(-1.961570560f));
+	__m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f(3.072711026f));
+	__m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f(2.053119869f), stbi__f2f(-0.390180644f));
+	__m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f(1.501321110f));
+
+	__m256i bias_0 = _mm256_set1_epi32(512);
+	__m256i bias_1 = _mm256_set1_epi32(65536 + (128 << 17));
+
+	row0 = dct_load(0);
+	row1 = dct_load(1);
+	row2 = dct_load(2);
+	row3 = dct_load(3);
+	row4 = dct_load(4);
+	row5 = dct_load(5);
+	row6 = dct_load(6);
+	row7 = dct_load(7);
+
+	// column pass
+	dct_pass(bias_0, 10);
+
+	{
+		// 16bit 8x8 transposes, one per lane
+		dct_interleave16(row0, row4);
+		dct_interleave16(row1, row5);
+		dct_interleave16(row2, row6);
+		dct_interleave16(row3, row7);
+
+		dct_interleave16(row0, row2);
+		dct_interleave16(row1, row3);
+		dct_interleave16(row4, row6);
+		dct_interleave16(row5, row7);
+
+		dct_interleave16(row0, row1);
+		dct_interleave16(row2, row3);
+		dct_interleave16(row4, row5);
+		dct_interleave16(row6, row7);
+	}
+
+	// row pass
+	dct_pass(bias_1, 17);
+
+	{
+		// pack
+		__m256i p0 = _mm256_packus_epi16(row0, row1);
+		__m256i p1 = _mm256_packus_epi16(row2, row3);
+		__m256i p2 = _mm256_packus_epi16(row4, row5);
+		__m256i p3 = _mm256_packus_epi16(row6, row7);
+
+		// 8bit 8x8 transposes, one per lane
+		dct_interleave8(p0, p2);
+		dct_interleave8(p1, p3);
+
+		dct_interleave8(p0, p1);
+		dct_interleave8(p2, p3);
+
+		dct_interleave8(p0, p2);
+		dct_interleave8(p1, p3);
+
+		// store; rows 0 and 1 are in p0, 2 and 3 in p2, 4 and 5 in p1, 6 and 7 in p3
+		dct_store2(p0);
+		dct_store2(p2);
+		dct_store2(p1);
+		dct_store2(p3);
+	}
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store2
+}
+#endif // STBI__AVX2
+
+#ifdef STBI_NEON
+
+// NEON integer IDCT. should produce bit-identical
+// results to the generic C version.
+static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
+{
+	int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+
+	int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
+	int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
+	int16x4_t rot0_2 = vdup_n_s16(stbi__f2f(0.765366865f));
+	int16x4_t rot1_0 = vdup_n_s16(stbi__f2f(1.175875602f));
+	int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
 	int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
 	int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
 	int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
@@ -2886,68 +3818,220 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
 	// since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// number of MCUs in the current scan; a non-interleaved scan codes every block
+// as its own MCU
+static int stbi__jpeg_scan_mcus(stbi__jpeg *z)
 {
-	stbi__jpeg_reset(z);
-	if (!z->progressive) {
+	if (z->scan_n == 1) {
+		int n = z->order[0];
+		return ((z->img_comp[n].x + 7) >> 3) * ((z->img_comp[n].y + 7) >> 3);
+	}
+	return z->img_mcu_x * z->img_mcu_y;
+}
+
+// idct two horizontally adjacent blocks, data[0..63] to out and data[64..127] just right of it
+static void stbi__jpeg_idct_pair(stbi__jpeg *z, stbi_uc *out, int out_stride, short data[128])
+{
+	if (z->idct_pair_kernel) {
+		z->idct_pair_kernel(out, out_stride, data);
+	} else {
+		z->idct_block_kernel(out, out_stride, data);
+		z->idct_block_kernel(out + (8 >> z->scale_shift), out_stride, data + 64);
+	}
+}
+
+// decode MCUs [start, end) of a baseline scan, in scanline order
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int start, int end)
+{
+	int m, k, x, y;
+	int bs = 8 >> z->scale_shift;
+	stbi_uc *held = NULL; // where the block waiting in data[0..63] goes
+	STBI_SIMD_ALIGN(short, data[128]);
+	for (m = start; m < end; ++m) {
 		if (z->scan_n == 1) {
-			int i, j;
-			STBI_SIMD_ALIGN(short, data[64]);
-			int n = z->order[0];
 			// non-interleaved data, we just need to process one block at a time,
-			// in trivial scanline order
-			// number of blocks to do just depends on how many actual "pixels" this
-			// component has, independent of interleaved MCU blocking and such
+			// in trivial scanline order. a block whose right neighbour is next
+			// waits for it so the two can be idct'd together
+			int n = z->order[0];
 			int w = (z->img_comp[n].x + 7) >> 3;
-			int h = (z->img_comp[n].y + 7) >> 3;
-			for (j = 0; j < h; ++j) {
-				for (i = 0; i < w; ++i) {
-					int ha = z->img_comp[n].ha;
-					if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
-					// every data block is an MCU, so countdown the restart interval
-					if (--z->todo <= 0) {
-						if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-						// if it's NOT a restart, then just bail, so we get corrupt data
-						// rather than no data
-						if (!STBI__RESTART(z->marker)) return 1;
-						stbi__jpeg_reset(z);
-					}
-				}
+			int i = m % w, j = m / w;
+			int ha = z->img_comp[n].ha;
+			stbi_uc *out = z->img_comp[n].data + z->img_comp[n].w2*j * bs + i * bs;
+			if (!stbi__jpeg_decode_block(z, data + (held ? 64 : 0), z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+			if (held) {
+				stbi__jpeg_idct_pair(z, held, z->img_comp[n].w2, data);
+				held = NULL;
+			} else if (i + 1 < w && m + 1 < end) {
+				held = out;
+			} else {
+				z->idct_block_kernel(out, z->img_comp[n].w2, data);
 			}
-			return 1;
 		}
-		else { // interleaved
-			int i, j, k, x, y;
-			STBI_SIMD_ALIGN(short, data[64]);
-			for (j = 0; j < z->img_mcu_y; ++j) {
-				for (i = 0; i < z->img_mcu_x; ++i) {
-					// scan an interleaved mcu... process scan_n components in order
-					for (k = 0; k < z->scan_n; ++k) {
-						int n = z->order[k];
-						// scan out an mcu's worth of this component; that's just determined
-						// by the basic H and V specified for the component
-						for (y = 0; y < z->img_comp[n].v; ++y) {
-							for (x = 0; x < z->img_comp[n].h; ++x) {
-								int x2 = (i*z->img_comp[n].h + x) * 8;
-								int y2 = (j*z->img_comp[n].v + y) * 8;
-								int ha = z->img_comp[n].ha;
-								if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-								z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
-							}
-						}
-					}
-					// after all interleaved components, that's an interleaved MCU,
-					// so now count down the restart interval
-					if (--z->todo <= 0) {
-						if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-						if (!STBI__RESTART(z->marker)) return 1;
-						stbi__jpeg_reset(z);
+		else {
+			int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+			// scan an interleaved mcu... process scan_n components in order
+			for (k = 0; k < z->scan_n; ++k) {
+				int n = z->order[k];
+				// scan out an mcu's worth of this component; that's just determined
+				// by the basic H and V specified for the component
+				for (y = 0; y < z->img_comp[n].v; ++y) {
+					for (x = 0; x < z->img_comp[n].h; x += 2) {
+						int x2 = (i*z->img_comp[n].h + x) * bs;
+						int y2 = (j*z->img_comp[n].v + y) * bs;
+						int ha = z->img_comp[n].ha;
+						int pair = x + 1 < z->img_comp[n].h;
+						if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+						if (pair && !stbi__jpeg_decode_block(z, data + 64, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+						if (pair)
+							stbi__jpeg_idct_pair(z, z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
+						else
+							z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
 					}
 				}
 			}
-			return 1;
 		}
+		// count down the restart interval
+		if (--z->todo <= 0) {
+			if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+			// if it's NOT a restart, then just bail, so we get corrupt data
+			// rather than no data
+			if (!STBI__RESTART(z->marker)) {
+				if (held) z->idct_block_kernel(held, z->img_comp[z->order[0]].w2, data);
+				return 1;
+			}
+			stbi__jpeg_reset(z);
+		}
+	}
+	return 1;
+}
+
+#ifndef STBI_JPEG_PARALLEL_MIN_PIXELS
+#define STBI_JPEG_PARALLEL_MIN_PIXELS  (512 * 512)
+#endif
+#define STBI__JPEG_PARALLEL_MAX_JOBS   64
+
+typedef struct
+{
+	stbi__jpeg *z;
+	stbi_uc **starts;    // entropy data of each restart interval, plus the end of the scan
+	int intervals, jobs, mcus;
+	const char *failure[STBI__JPEG_PARALLEL_MAX_JOBS]; // each job's own error, merged once all are done
+} stbi__jpeg_parallel;
+
+// decodes a contiguous run of restart intervals with a private copy of the
+// decoder state, writing into the shared component planes
+static void stbi__jpeg_parallel_job(void *task_data, int job)
+{
+	stbi__jpeg_parallel *p = (stbi__jpeg_parallel *)task_data;
+	int first = (int)((stbi__uint64)job * p->intervals / p->jobs);
+	int last = (int)((stbi__uint64)(job + 1) * p->intervals / p->jobs);
+	int end = last * p->z->restart_interval;
+	stbi__context s = *p->z->s;
+	stbi__jpeg *z = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
+	if (!z) {
+		p->failure[job] = "outofmem";
+		return;
+	}
+	memcpy(z, p->z, sizeof(stbi__jpeg));
+	// ending the buffer at the next interval means the bit reader pads with
+	// zeros instead of running into someone else's data
+	s.img_buffer = p->starts[first];
+	s.img_buffer_end = p->starts[last];
+	z->s = &s;
+	stbi__jpeg_reset(z);
+	if (!stbi__jpeg_decode_mcus(z, first * z->restart_interval, end < p->mcus ? end : p->mcus))
+		p->failure[job] = stbi_failure_reason();
+	STBI_FREE(z);
+}
+
+// returns -1 if the scan can't be split up, so the caller should decode it serially
+static int stbi__jpeg_decode_parallel(stbi__jpeg *z)
+{
+	stbi__context *s = z->s;
+	stbi__jpeg_parallel p;
+	stbi_uc *c;
+	int found = 1, i;
+
+	// restart markers have to be found ahead of decoding, so all the data has
+	// to be in memory
+	if (!stbi__jpeg_parallel_for || !z->restart_interval || s->read_from_callbacks) return -1;
+	if ((stbi__uint64)s->img_x * s->img_y < STBI_JPEG_PARALLEL_MIN_PIXELS) return -1;
+	p.z = z;
+	p.mcus = stbi__jpeg_scan_mcus(z);
+	p.intervals = (p.mcus + z->restart_interval - 1) / z->restart_interval;
+	if (p.intervals < 2) return -1;
+	p.starts = (stbi_uc **)stbi__malloc_mad2(p.intervals + 1, sizeof(stbi_uc *), 0);
+	if (!p.starts) return -1;
+
+	// 0xff is always followed by a stuffed 0, a fill 0xff or a marker; RSTn
+	// separates intervals, and anything else ends the scan
+	p.starts[0] = s->img_buffer;
+	for (c = s->img_buffer; c + 1 < s->img_buffer_end; ++c) {
+		if (c[0] != 0xff || c[1] == 0x00 || c[1] == 0xff) continue;
+		if (!STBI__RESTART(c[1])) break;
+		// out-of-sequence or extra markers are left for the serial decoder
+		if (found == p.intervals || c[1] != 0xd0 + ((found - 1) & 7)) { found = 0; break; }
+		p.starts[found++] = c + 2;
+		++c;
+	}
+	if (found != p.intervals) {
+		STBI_FREE(p.starts);
+		return -1;
+	}
+	if (c + 1 >= s->img_buffer_end) c = s->img_buffer_end;
+	p.starts[p.intervals] = c;
+
+	p.jobs = p.intervals < STBI__JPEG_PARALLEL_MAX_JOBS ? p.intervals : STBI__JPEG_PARALLEL_MAX_JOBS;
+	memset(p.failure, 0, sizeof(p.failure));
+	stbi__jpeg_parallel_for(stbi__jpeg_parallel_user, p.jobs, stbi__jpeg_parallel_job, &p);
+	STBI_FREE(p.starts);
+	for (i = 0; i < p.jobs; ++i)
+		if (p.failure[i]) return stbi__err(p.failure[i], p.failure[i]);
+
+	// leave the stream at the marker that ended the scan
+	s->img_buffer = c;
+	z->marker = STBI__MARKER_none;
+	return 1;
+}
+
+static int stbi__jpeg_begin_output(stbi__jpeg *z);
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi__uint32 end);
+
+// decodes a scan that codes the whole image an MCU row at a time, handing out the
+// rows above each one as soon as it's done
+static int stbi__jpeg_decode_streaming(stbi__jpeg *z)
+{
+	int mcus = stbi__jpeg_scan_mcus(z);
+	int per_row, band, m;
+	if (z->scan_n == 1) {
+		per_row = (z->img_comp[z->order[0]].x + 7) >> 3;
+		band = 8;
+	}
+	else {
+		per_row = z->img_mcu_x;
+		band = z->img_mcu_h;
+	}
+	if (!stbi__jpeg_begin_output(z)) return 0;
+	for (m = 0; m < mcus; m += per_row) {
+		stbi__uint32 ready;
+		if (!stbi__jpeg_decode_mcus(z, m, m + per_row < mcus ? m + per_row : mcus)) return 0;
+		// the upsamplers read a row ahead, so convert up to the previous MCU row
+		ready = (stbi__uint32)(m / per_row) * band;
+		if (ready > z->s->img_y) ready = z->s->img_y;
+		if (ready > z->rows_out) stbi__jpeg_convert_rows(z, ready);
+	}
+	return 1;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+	stbi__jpeg_reset(z);
+	if (!z->progressive) {
+		int r = stbi__jpeg_decode_parallel(z);
+		if (r >= 0) return r;
+		if (z->ri && z->ri->rows && z->ri->dest && !z->output && !z->scale_shift && z->scan_n == z->s->img_n)
+			return stbi__jpeg_decode_streaming(z);
+		return stbi__jpeg_decode_mcus(z, 0, stbi__jpeg_scan_mcus(z));
 	}
 	else {
 		if (z->scan_n == 1) {
@@ -3026,14 +4110,21 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
 	if (z->progressive) {
 		// dequantize and idct the data
 		int i, j, n;
+		int bs = 8 >> z->scale_shift;
 		for (n = 0; n < z->s->img_n; ++n) {
 			int w = (z->img_comp[n].x + 7) >> 3;
 			int h = (z->img_comp[n].y + 7) >> 3;
 			for (j = 0; j < h; ++j) {
-				for (i = 0; i < w; ++i) {
+				for (i = 0; i < w; i += 2) {
 					short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
 					stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
+					if (i + 1 < w) {
+						// the right neighbour's coefficients follow directly
+						stbi__jpeg_dequantize(data + 64, z->dequant[z->img_comp[n].tq]);
+						stbi__jpeg_idct_pair(z, z->img_comp[n].data + z->img_comp[n].w2*j * bs + i * bs, z->img_comp[n].w2, data);
+					} else {
+						z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * bs + i * bs, z->img_comp[n].w2, data);
+					}
 				}
 			}
 		}
@@ -3267,9 +4358,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 		// discard the extra data until colorspace conversion
 		//
 		// img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
-		// so these muls can't overflow with 32-bit ints (which we require)
-		z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-		z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+		// so these muls can't overflow with 32-bit ints (which we require).
+		// scaled decodes produce smaller blocks, so the planes shrink with them
+		z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+		z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
 		z->img_comp[i].coeff = 0;
 		z->img_comp[i].raw_coeff = 0;
 		z->img_comp[i].linebuf = NULL;
@@ -3279,10 +4371,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 		// align blocks for idct using mmx/sse
 		z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
 		if (z->progressive) {
-			// w2, h2 are multiples of 8 (see above)
-			z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-			z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-			z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+			// coefficients are always kept for every 8x8 block
+			z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+			z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+			z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
 			if (z->img_comp[i].raw_coeff == NULL)
 				return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
 			z->img_comp[i].coeff = (short*)(((size_t)z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3328,7 +4420,7 @@ static int stbi__decode_jpeg_header(stbi__jpeg *z, int scan)
 // decode image to YCbCr format
 static int stbi__decode_jpeg_image(stbi__jpeg *j)
 {
-	int m;
+	int m, ok, phase;
 	for (m = 0; m < 4; m++) {
 		j->img_comp[m].raw_data = NULL;
 		j->img_comp[m].raw_coeff = NULL;
@@ -3339,7 +4431,10 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
 	while (!stbi__EOI(m)) {
 		if (stbi__SOS(m)) {
 			if (!stbi__process_scan_header(j)) return 0;
-			if (!stbi__parse_entropy_coded_data(j)) return 0;
+			phase = stbi__phase_enter(STBI_PHASE_ENTROPY);
+			ok = stbi__parse_entropy_coded_data(j);
+			stbi__phase_leave(phase);
+			if (!ok) return 0;
 			if (j->marker == STBI__MARKER_none) {
 				// handle 0s at the end of image data from IP Kamera 9060
 				while (!stbi__at_eof(j->s)) {
@@ -3363,16 +4458,16 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
 		}
 		m = stbi__get_marker(j);
 	}
-	if (j->progressive)
+	if (j->progressive) {
+		phase = stbi__phase_enter(STBI_PHASE_TRANSFORM);
 		stbi__jpeg_finish(j);
+		stbi__phase_leave(phase);
+	}
 	return 1;
 }
 
 // static jfif-centered resampling (across block boundaries)
 
-typedef stbi_uc *(*resample_row_func)(stbi_uc *out, stbi_uc *in0, stbi_uc *in1,
-	int w, int hs);
-
 #define stbi__div4(x) ((stbi_uc) ((x) >> 2))
 
 static stbi_uc *resample_row_1(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
@@ -3599,7 +4694,7 @@ static void stbi__YCbCr_to_RGB_row(stbi_uc *out, const stbi_uc *y, const stbi_uc
 		out[0] = (stbi_uc)r;
 		out[1] = (stbi_uc)g;
 		out[2] = (stbi_uc)b;
-		out[3] = 255;
+		if (step == 4) out[3] = 255; // with step 3 this would spill into the next row, which flipped output has already written
 		out += step;
 	}
 }
@@ -3733,24 +4828,296 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 		out[0] = (stbi_uc)r;
 		out[1] = (stbi_uc)g;
 		out[2] = (stbi_uc)b;
-		out[3] = 255;
+		if (step == 4) out[3] = 255; // with step 3 this would spill into the next row, which flipped output has already written
 		out += step;
 	}
 }
 #endif
 
+#ifdef STBI_SSE2
+static stbi_uc *stbi__resample_row_v_2_simd(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+	// same as stbi__resample_row_v_2, 16 samples at a time. the sums need 10
+	// bits, so widen to 16 bits rather than approximating with byte averages.
+	int i = 0;
+	__m128i zero = _mm_setzero_si128();
+	__m128i bias = _mm_set1_epi16(2);
+	for (; i + 15 < w; i += 16) {
+		__m128i nearb = _mm_loadu_si128((__m128i *) (in_near + i));
+		__m128i farb = _mm_loadu_si128((__m128i *) (in_far + i));
+		__m128i nlo = _mm_unpacklo_epi8(nearb, zero);
+		__m128i nhi = _mm_unpackhi_epi8(nearb, zero);
+		__m128i flo = _mm_add_epi16(_mm_unpacklo_epi8(farb, zero), bias);
+		__m128i fhi = _mm_add_epi16(_mm_unpackhi_epi8(farb, zero), bias);
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(nlo, 1), nlo), flo);
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(nhi, 1), nhi), fhi);
+		__m128i outv = _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+		_mm_storeu_si128((__m128i *) (out + i), outv);
+	}
+	for (; i < w; ++i)
+		out[i] = stbi__div4(3 * in_near[i] + in_far[i] + 2);
+	STBI_NOTUSED(hs);
+	return out;
+}
+
+static stbi_uc *stbi__resample_row_h_2_simd(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+	// same as stbi__resample_row_h_2; each group of 8 pixels also reads its left
+	// and right neighbour, so the loop stops one pixel short of the row end.
+	int i;
+	stbi_uc *input = in_near;
+
+	if (w == 1) {
+		out[0] = out[1] = input[0];
+		return out;
+	}
+
+	out[0] = input[0];
+	out[1] = stbi__div4(input[0] * 3 + input[1] + 2);
+	for (i = 1; i + 8 < w; i += 8) {
+		__m128i zero = _mm_setzero_si128();
+		__m128i bias = _mm_set1_epi16(2);
+		__m128i prvw = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (input + i - 1)), zero);
+		__m128i curw = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (input + i)), zero);
+		__m128i nxtw = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (input + i + 1)), zero);
+		__m128i n = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(curw, 1), curw), bias);
+		__m128i even = _mm_srli_epi16(_mm_add_epi16(n, prvw), 2);
+		__m128i odd = _mm_srli_epi16(_mm_add_epi16(n, nxtw), 2);
+		__m128i outv = _mm_packus_epi16(_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd));
+		_mm_storeu_si128((__m128i *) (out + i * 2), outv);
+	}
+	for (; i < w - 1; ++i) {
+		int n = 3 * input[i] + 2;
+		out[i * 2 + 0] = stbi__div4(n + input[i - 1]);
+		out[i * 2 + 1] = stbi__div4(n + input[i + 1]);
+	}
+	out[i * 2 + 0] = stbi__div4(input[w - 2] * 3 + input[w - 1] + 2);
+	out[i * 2 + 1] = input[w - 1];
+
+	STBI_NOTUSED(in_far);
+	STBI_NOTUSED(hs);
+
+	return out;
+}
+
+static stbi_uc *stbi__resample_row_generic_simd(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+	// nearest-neighbor by 2 or 4 is just byte replication, which the unpacks do
+	int i = 0, j;
+	if (hs == 2) {
+		for (; i + 15 < w; i += 16) {
+			__m128i v = _mm_loadu_si128((__m128i *) (in_near + i));
+			_mm_storeu_si128((__m128i *) (out + i * 2), _mm_unpacklo_epi8(v, v));
+			_mm_storeu_si128((__m128i *) (out + i * 2 + 16), _mm_unpackhi_epi8(v, v));
+		}
+	} else if (hs == 4) {
+		for (; i + 15 < w; i += 16) {
+			__m128i v = _mm_loadu_si128((__m128i *) (in_near + i));
+			__m128i lo = _mm_unpacklo_epi8(v, v);
+			__m128i hi = _mm_unpackhi_epi8(v, v);
+			_mm_storeu_si128((__m128i *) (out + i * 4), _mm_unpacklo_epi16(lo, lo));
+			_mm_storeu_si128((__m128i *) (out + i * 4 + 16), _mm_unpackhi_epi16(lo, lo));
+			_mm_storeu_si128((__m128i *) (out + i * 4 + 32), _mm_unpacklo_epi16(hi, hi));
+			_mm_storeu_si128((__m128i *) (out + i * 4 + 48), _mm_unpackhi_epi16(hi, hi));
+		}
+	}
+	for (; i < w; ++i)
+		for (j = 0; j < hs; ++j)
+			out[i*hs + j] = in_near[i];
+	STBI_NOTUSED(in_far);
+	return out;
+}
+#endif
+
+#ifdef STBI__AVX2
+// the AVX2 kernels do exactly the same arithmetic as the SSE2 ones, twice as
+// wide. packs and unpacks only work within 128-bit lanes, so the results get
+// shuffled back into order before they're stored.
+
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_v_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+	int i = 0;
+	__m256i bias = _mm256_set1_epi16(2);
+	for (; i + 31 < w; i += 32) {
+		__m256i nlo = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+		__m256i nhi = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i + 16)));
+		__m256i flo = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+		__m256i fhi = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i + 16)));
+		__m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(nlo, 1), nlo), _mm256_add_epi16(flo, bias));
+		__m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(nhi, 1), nhi), _mm256_add_epi16(fhi, bias));
+		__m256i outv = _mm256_packus_epi16(_mm256_srli_epi16(lo, 2), _mm256_srli_epi16(hi, 2));
+		_mm256_storeu_si256((__m256i *) (out + i), _mm256_permute4x64_epi64(outv, 0xd8));
+	}
+	for (; i < w; ++i)
+		out[i] = stbi__div4(3 * in_near[i] + in_far[i] + 2);
+	STBI_NOTUSED(hs);
+	return out;
+}
+
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+	// see stbi__resample_row_hv_2_simd for the details of the filter
+	int i = 0, t0, t1;
+
+	if (w == 1) {
+		out[0] = out[1] = stbi__div4(3 * in_near[0] + in_far[0] + 2);
+		return out;
+	}
+
+	t1 = 3 * in_near[0] + in_far[0];
+	for (; i < ((w - 1) & ~15); i += 16) {
+		// vertical pass
+		__m256i farw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+		__m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+		__m256i diff = _mm256_sub_epi16(farw, nearw);
+		__m256i nears = _mm256_slli_epi16(nearw, 2);
+		__m256i curr = _mm256_add_epi16(nears, diff);
+
+		// shifting by one pixel crosses the lane boundary, so splice each lane
+		// with its neighbour: lo = [0, curr.lo], hi = [curr.hi, 0]
+		__m256i lo = _mm256_permute2x128_si256(curr, curr, 0x08);
+		__m256i hi = _mm256_permute2x128_si256(curr, curr, 0x81);
+		__m256i prv0 = _mm256_alignr_epi8(curr, lo, 14);
+		__m256i nxt0 = _mm256_alignr_epi8(hi, curr, 2);
+		__m128i nxtv = _mm_insert_epi16(_mm_setzero_si128(), 3 * in_near[i + 16] + in_far[i + 16], 7);
+		__m256i prev = _mm256_or_si256(prv0, _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_cvtsi32_si128(t1), 0));
+		__m256i next = _mm256_or_si256(nxt0, _mm256_inserti128_si256(_mm256_setzero_si256(), nxtv, 1));
+
+		// horizontal pass
+		__m256i bias = _mm256_set1_epi16(8);
+		__m256i curs = _mm256_slli_epi16(curr, 2);
+		__m256i prvd = _mm256_sub_epi16(prev, curr);
+		__m256i nxtd = _mm256_sub_epi16(next, curr);
+		__m256i curb = _mm256_add_epi16(curs, bias);
+		__m256i even = _mm256_add_epi16(prvd, curb);
+		__m256i odd = _mm256_add_epi16(nxtd, curb);
+
+		// interleave and undo scaling; the in-lane pack leaves pixels 0-7 in
+		// the low lane and 8-15 in the high lane, which is already in order
+		__m256i int0 = _mm256_unpacklo_epi16(even, odd);
+		__m256i int1 = _mm256_unpackhi_epi16(even, odd);
+		__m256i de0 = _mm256_srli_epi16(int0, 4);
+		__m256i de1 = _mm256_srli_epi16(int1, 4);
+		__m256i outv = _mm256_packus_epi16(de0, de1);
+		_mm256_storeu_si256((__m256i *) (out + i * 2), outv);
+
+		t1 = 3 * in_near[i + 15] + in_far[i + 15];
+	}
+
+	t0 = t1;
+	t1 = 3 * in_near[i] + in_far[i];
+	out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+
+	for (++i; i < w; ++i) {
+		t0 = t1;
+		t1 = 3 * in_near[i] + in_far[i];
+		out[i * 2 - 1] = stbi__div16(3 * t0 + t1 + 8);
+		out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+	}
+	out[w * 2 - 1] = stbi__div4(t1 + 2);
+
+	STBI_NOTUSED(hs);
+
+	return out;
+}
+
+static STBI__AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+	int i = 0;
+
+	if (step == 4) {
+		__m128i signflip = _mm_set1_epi8(-0x80);
+		__m256i cr_const0 = _mm256_set1_epi16((short)(1.40200f*4096.0f + 0.5f));
+		__m256i cr_const1 = _mm256_set1_epi16(-(short)(0.71414f*4096.0f + 0.5f));
+		__m256i cb_const0 = _mm256_set1_epi16(-(short)(0.34414f*4096.0f + 0.5f));
+		__m256i cb_const1 = _mm256_set1_epi16((short)(1.77200f*4096.0f + 0.5f));
+		__m256i y_bias = _mm256_set1_epi16(128);
+		__m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+		for (; i + 15 < count; i += 16) {
+			// load
+			__m128i y_bytes = _mm_loadu_si128((__m128i *) (y + i));
+			__m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr + i));
+			__m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb + i));
+			__m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+			__m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+			// widen to short, matching the SSE2 unpacks: y becomes (y << 8) | 128,
+			// cr and cb are left-shifted by 8
+			__m256i yw = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+			__m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+			__m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+			// color transform
+			__m256i yws = _mm256_srli_epi16(yw, 4);
+			__m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+			__m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+			__m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+			__m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+			__m256i rws = _mm256_add_epi16(cr0, yws);
+			__m256i gwt = _mm256_add_epi16(cb0, yws);
+			__m256i bws = _mm256_add_epi16(yws, cb1);
+			__m256i gws = _mm256_add_epi16(gwt, cr1);
+
+			// descale
+			__m256i rw = _mm256_srai_epi16(rws, 4);
+			__m256i bw = _mm256_srai_epi16(bws, 4);
+			__m256i gw = _mm256_srai_epi16(gws, 4);
+
+			// back to byte, set up for transpose
+			__m256i brb = _mm256_packus_epi16(rw, bw);
+			__m256i gxb = _mm256_packus_epi16(gw, xw);
+
+			// transpose to interleave channels; o0 ends up with pixels 0-3 and
+			// 8-11, o1 with pixels 4-7 and 12-15
+			__m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+			__m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+			__m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+			__m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+			// store
+			_mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+			_mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+			out += 64;
+		}
+	}
+
+	// leftovers (and step == 3) go through the 128-bit kernel
+	stbi__YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
 	j->idct_block_kernel = stbi__idct_block;
+	j->idct_pair_kernel = NULL;
 	j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
 	j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
+	j->resample_row_v_2_kernel = stbi__resample_row_v_2;
+	j->resample_row_h_2_kernel = stbi__resample_row_h_2;
+	j->resample_row_generic_kernel = stbi__resample_row_generic;
+	j->scale_shift = 0;
+	j->ri = NULL;
+	j->output = NULL;
 
 #ifdef STBI_SSE2
 	if (stbi__sse2_available()) {
 		j->idct_block_kernel = stbi__idct_simd;
 		j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
 		j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+		j->resample_row_v_2_kernel = stbi__resample_row_v_2_simd;
+		j->resample_row_h_2_kernel = stbi__resample_row_h_2_simd;
+		j->resample_row_generic_kernel = stbi__resample_row_generic_simd;
+	}
+#endif
+
+#ifdef STBI__AVX2
+	if (stbi__avx2_available()) {
+		j->idct_pair_kernel = stbi__idct_avx2;
+		j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+		j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+		j->resample_row_v_2_kernel = stbi__resample_row_v_2_avx2;
 	}
 #endif
 
@@ -3767,16 +5134,6 @@ static void stbi__cleanup_jpeg(stbi__jpeg *j)
 	stbi__free_jpeg_components(j, j->s->img_n, 0);
 }
 
-typedef struct
-{
-	resample_row_func resample;
-	stbi_uc *line0, *line1;
-	int hs, vs;   // expansion factor in each axis
-	int w_lores; // horizontal pixels pre-expansion
-	int ystep;   // how far through vertical expansion we are
-	int ypos;    // which pre-expansion row we're on
-} stbi__resample;
-
 // fast 0..255 * 0..255 => 0..255 rounded multiplication
 static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
 {
@@ -3784,181 +5141,221 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
 	return (stbi_uc)((t + (t >> 8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// sets up color conversion of the decoded component planes into the output, which
+// is the caller's buffer if there is one
+static int stbi__jpeg_begin_output(stbi__jpeg *z)
 {
-	int n, decode_n, is_rgb;
-	z->s->img_n = 0; // make stbi__cleanup_jpeg safe
-
-	// validate req_comp
-	if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
-
-	// load a jpeg image from whichever source, but leave in YCbCr format
-	if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+	int k;
+	stbi__result_info *ri = z->ri;
 
 	// determine actual number of components to generate
-	n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+	z->out_n = z->req_comp ? z->req_comp : z->s->img_n >= 3 ? 3 : 1;
 
-	is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+	z->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
 
-	if (z->s->img_n == 3 && n < 3 && !is_rgb)
-		decode_n = 1;
+	if (z->s->img_n == 3 && z->out_n < 3 && !z->is_rgb)
+		z->decode_n = 1;
 	else
-		decode_n = z->s->img_n;
+		z->decode_n = z->s->img_n;
 
-	// resample and color-convert
-	{
-		int k;
-		unsigned int i, j;
-		stbi_uc *output;
-		stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+	for (k = 0; k < z->decode_n; ++k) {
+		stbi__resample *r = &z->res_comp[k];
+
+		// allocate line buffer big enough for upsampling off the edges
+		// with upsample factor of 4
+		z->img_comp[k].linebuf = (stbi_uc *)stbi__malloc(z->s->img_x + 3);
+		if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
 
-		stbi__resample res_comp[4];
+		r->hs = z->img_h_max / z->img_comp[k].h;
+		r->vs = z->img_v_max / z->img_comp[k].v;
+		r->ystep = r->vs >> 1;
+		r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
+		r->ypos = 0;
+		r->line0 = r->line1 = z->img_comp[k].data;
 
+		if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+		else if (r->hs == 1 && r->vs == 2) r->resample = z->resample_row_v_2_kernel;
+		else if (r->hs == 2 && r->vs == 1) r->resample = z->resample_row_h_2_kernel;
+		else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+		else                               r->resample = z->resample_row_generic_kernel;
+	}
+
+	if (ri->dest) {
+		z->out_stride = stbi__dest_stride(ri, z->s->img_x, z->s->img_y, z->out_n);
+		if (z->out_stride == 0) return stbi__err("buffer too small", "Image doesn't fit the destination");
+		z->output = ri->dest;
+	}
+	else {
+		z->out_stride = (size_t)z->out_n * z->s->img_x;
+		z->output = (stbi_uc *)stbi__malloc_mad3(z->out_n, z->s->img_x, z->s->img_y, 1);
+		if (!z->output) return stbi__err("outofmem", "Out of memory");
+	}
+	z->rows_out = 0;
+	return 1;
+}
+
+// resamples and color-converts output rows [z->rows_out, end)
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi__uint32 end)
+{
+	int k, n = z->out_n, decode_n = z->decode_n, is_rgb = z->is_rgb;
+	int phase = stbi__phase_enter(STBI_PHASE_COLOR);
+	unsigned int i, j;
+	stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+
+	for (j = z->rows_out; j < end; ++j) {
+		stbi_uc *out = z->output + z->out_stride * (z->ri->flip_vertically ? z->s->img_y - 1 - j : j);
 		for (k = 0; k < decode_n; ++k) {
-			stbi__resample *r = &res_comp[k];
-
-			// allocate line buffer big enough for upsampling off the edges
-			// with upsample factor of 4
-			z->img_comp[k].linebuf = (stbi_uc *)stbi__malloc(z->s->img_x + 3);
-			if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-			r->hs = z->img_h_max / z->img_comp[k].h;
-			r->vs = z->img_v_max / z->img_comp[k].v;
-			r->ystep = r->vs >> 1;
-			r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
-			r->ypos = 0;
-			r->line0 = r->line1 = z->img_comp[k].data;
-
-			if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-			else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-			else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-			else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-			else                               r->resample = stbi__resample_row_generic;
-		}
-
-		// can't error after this so, this is safe
-		output = (stbi_uc *)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-		if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-		// now go ahead and resample
-		for (j = 0; j < z->s->img_y; ++j) {
-			stbi_uc *out = output + n * z->s->img_x * j;
-			for (k = 0; k < decode_n; ++k) {
-				stbi__resample *r = &res_comp[k];
-				int y_bot = r->ystep >= (r->vs >> 1);
-				coutput[k] = r->resample(z->img_comp[k].linebuf,
-					y_bot ? r->line1 : r->line0,
-					y_bot ? r->line0 : r->line1,
-					r->w_lores, r->hs);
-				if (++r->ystep >= r->vs) {
-					r->ystep = 0;
-					r->line0 = r->line1;
-					if (++r->ypos < z->img_comp[k].y)
-						r->line1 += z->img_comp[k].w2;
-				}
+			stbi__resample *r = &z->res_comp[k];
+			int y_bot = r->ystep >= (r->vs >> 1);
+			coutput[k] = r->resample(z->img_comp[k].linebuf,
+				y_bot ? r->line1 : r->line0,
+				y_bot ? r->line0 : r->line1,
+				r->w_lores, r->hs);
+			if (++r->ystep >= r->vs) {
+				r->ystep = 0;
+				r->line0 = r->line1;
+				if (++r->ypos < z->img_comp[k].y)
+					r->line1 += z->img_comp[k].w2;
 			}
-			if (n >= 3) {
-				stbi_uc *y = coutput[0];
-				if (z->s->img_n == 3) {
-					if (is_rgb) {
-						for (i = 0; i < z->s->img_x; ++i) {
-							out[0] = y[i];
-							out[1] = coutput[1][i];
-							out[2] = coutput[2][i];
-							out[3] = 255;
-							out += n;
-						}
-					}
-					else {
-						z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-					}
-				}
-				else if (z->s->img_n == 4) {
-					if (z->app14_color_transform == 0) { // CMYK
-						for (i = 0; i < z->s->img_x; ++i) {
-							stbi_uc m = coutput[3][i];
-							out[0] = stbi__blinn_8x8(coutput[0][i], m);
-							out[1] = stbi__blinn_8x8(coutput[1][i], m);
-							out[2] = stbi__blinn_8x8(coutput[2][i], m);
-							out[3] = 255;
-							out += n;
-						}
-					}
-					else if (z->app14_color_transform == 2) { // YCCK
-						z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-						for (i = 0; i < z->s->img_x; ++i) {
-							stbi_uc m = coutput[3][i];
-							out[0] = stbi__blinn_8x8(255 - out[0], m);
-							out[1] = stbi__blinn_8x8(255 - out[1], m);
-							out[2] = stbi__blinn_8x8(255 - out[2], m);
-							out += n;
-						}
-					}
-					else { // YCbCr + alpha?  Ignore the fourth channel for now
-						z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-					}
-				}
-				else
-					for (i = 0; i < z->s->img_x; ++i) {
-						out[0] = out[1] = out[2] = y[i];
-						out[3] = 255; // not used if n==3
-						out += n;
-					}
-			}
-			else {
+		}
+		if (n >= 3) {
+			stbi_uc *y = coutput[0];
+			if (z->s->img_n == 3) {
 				if (is_rgb) {
-					if (n == 1)
-						for (i = 0; i < z->s->img_x; ++i)
-							*out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-					else {
-						for (i = 0; i < z->s->img_x; ++i, out += 2) {
-							out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-							out[1] = 255;
-						}
+					for (i = 0; i < z->s->img_x; ++i) {
+						out[0] = y[i];
+						out[1] = coutput[1][i];
+						out[2] = coutput[2][i];
+						if (n == 4) out[3] = 255;
+						out += n;
 					}
 				}
-				else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+				else {
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+				}
+			}
+			else if (z->s->img_n == 4) {
+				if (z->app14_color_transform == 0) { // CMYK
 					for (i = 0; i < z->s->img_x; ++i) {
 						stbi_uc m = coutput[3][i];
-						stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-						stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-						stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-						out[0] = stbi__compute_y(r, g, b);
-						out[1] = 255;
+						out[0] = stbi__blinn_8x8(coutput[0][i], m);
+						out[1] = stbi__blinn_8x8(coutput[1][i], m);
+						out[2] = stbi__blinn_8x8(coutput[2][i], m);
+						if (n == 4) out[3] = 255;
 						out += n;
 					}
 				}
-				else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+				else if (z->app14_color_transform == 2) { // YCCK
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
 					for (i = 0; i < z->s->img_x; ++i) {
-						out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-						out[1] = 255;
+						stbi_uc m = coutput[3][i];
+						out[0] = stbi__blinn_8x8(255 - out[0], m);
+						out[1] = stbi__blinn_8x8(255 - out[1], m);
+						out[2] = stbi__blinn_8x8(255 - out[2], m);
 						out += n;
 					}
 				}
+				else { // YCbCr + alpha?  Ignore the fourth channel for now
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+				}
+			}
+			else
+				for (i = 0; i < z->s->img_x; ++i) {
+					out[0] = out[1] = out[2] = y[i];
+					if (n == 4) out[3] = 255;
+					out += n;
+				}
+		}
+		else {
+			if (is_rgb) {
+				if (n == 1)
+					for (i = 0; i < z->s->img_x; ++i)
+						*out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
 				else {
-					stbi_uc *y = coutput[0];
-					if (n == 1)
-						for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
-					else
-						for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+					for (i = 0; i < z->s->img_x; ++i, out += 2) {
+						out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+						out[1] = 255;
+					}
 				}
 			}
+			else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+				for (i = 0; i < z->s->img_x; ++i) {
+					stbi_uc m = coutput[3][i];
+					stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+					stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+					stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+					out[0] = stbi__compute_y(r, g, b);
+					out[1] = 255;
+					out += n;
+				}
+			}
+			else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+				for (i = 0; i < z->s->img_x; ++i) {
+					out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+					out[1] = 255;
+					out += n;
+				}
+			}
+			else {
+				stbi_uc *y = coutput[0];
+				if (n == 1)
+					for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+				else
+					for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+			}
+		}
+	}
+	stbi__phase_leave(phase);
+	stbi__rows_done(z->ri, z->rows_out, end, z->s->img_y);
+	z->rows_out = end;
+}
+
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+	int n;
+	z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+	// validate req_comp
+	if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+	z->req_comp = req_comp;
+
+	// load a jpeg image from whichever source, but leave in YCbCr format; a
+	// streamed scan has already converted most of it
+	if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+
+	if (!z->output) {
+		// from here on everything works on the reduced size
+		if (z->scale_shift) {
+			z->s->img_x = (z->s->img_x + (1 << z->scale_shift) - 1) >> z->scale_shift;
+			z->s->img_y = (z->s->img_y + (1 << z->scale_shift) - 1) >> z->scale_shift;
+			for (n = 0; n < z->s->img_n; ++n)
+				z->img_comp[n].y = (z->img_comp[n].y + (1 << z->scale_shift) - 1) >> z->scale_shift;
 		}
-		stbi__cleanup_jpeg(z);
-		*out_x = z->s->img_x;
-		*out_y = z->s->img_y;
-		if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-		return output;
+		if (!stbi__jpeg_begin_output(z)) { stbi__cleanup_jpeg(z); return NULL; }
 	}
+
+	// can't error after this so, this is safe
+	stbi__jpeg_convert_rows(z, z->s->img_y);
+	stbi__cleanup_jpeg(z);
+	*out_x = z->s->img_x;
+	*out_y = z->s->img_y;
+	if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+	return z->output;
 }
 
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
 	unsigned char* result;
 	stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
-	STBI_NOTUSED(ri);
 	j->s = s;
 	stbi__setup_jpeg(j);
+	ri->flipped = ri->flip_vertically;
+	j->ri = ri;
+	j->scale_shift = stbi__jpeg_scale_shift;
+	if (j->scale_shift) j->idct_pair_kernel = NULL;
+	if (j->scale_shift == 1) j->idct_block_kernel = stbi__idct_4x4;
+	if (j->scale_shift == 2) j->idct_block_kernel = stbi__idct_2x2;
+	if (j->scale_shift == 3) j->idct_block_kernel = stbi__idct_1x1;
 	result = load_jpeg_image(j, x, y, comp, req_comp);
 	STBI_FREE(j);
 	return result;
@@ -4009,7 +5406,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  11 // accelerate all cases in default tables, and most in custom ones
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
 // zlib-style huffman encoding
@@ -4098,7 +5495,8 @@ typedef struct
 {
 	stbi_uc *zbuffer, *zbuffer_end;
 	int num_bits;
-	stbi__uint32 code_buffer;
+	int pad_bits; // how many of the top num_bits are zeros made up past the end of the input
+	stbi__uint64 code_buffer;
 
 	char *zout;
 	char *zout_start;
@@ -4106,11 +5504,17 @@ typedef struct
 	int   z_expandable;
 
 	stbi__zhuffman z_length, z_distance;
+
+	// for streaming: refill hands over the next piece of input when the buffer runs
+	// out, progress sees the output after every block
+	int (*refill)(void *user, stbi_uc **start, stbi_uc **end);
+	int (*progress)(void *user, char *start, char *end);
+	void *stream_user;
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
 {
-	return (z->zbuffer >= z->zbuffer_end);
+	return z->zbuffer >= z->zbuffer_end && !(z->refill && z->refill(z->stream_user, &z->zbuffer, &z->zbuffer_end));
 }
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -4120,21 +5524,51 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+	if (z->num_bits < 0 || z->code_buffer >= ((stbi__uint64)1 << z->num_bits)) {
+		z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+		z->refill = NULL;
+		return;
+	}
+	// fast path: top up with as many whole bytes as fit, from one 8-byte load
+	if (z->zbuffer_end - z->zbuffer >= 8) {
+		int n = (63 - z->num_bits) >> 3;
+		stbi__uint64 v;
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET)
+		memcpy(&v, z->zbuffer, 8); // little-endian, unaligned loads are fine
+#else
+		stbi_uc *p = z->zbuffer;
+		v = (stbi__uint64)p[0] | ((stbi__uint64)p[1] << 8) | ((stbi__uint64)p[2] << 16) | ((stbi__uint64)p[3] << 24) |
+			((stbi__uint64)p[4] << 32) | ((stbi__uint64)p[5] << 40) | ((stbi__uint64)p[6] << 48) | ((stbi__uint64)p[7] << 56);
+#endif
+		v &= ((stbi__uint64)1 << (n * 8)) - 1;
+		z->code_buffer |= v << z->num_bits;
+		z->num_bits += n * 8;
+		z->zbuffer += n;
+		return;
+	}
 	do {
-		if (z->code_buffer >= (1U << z->num_bits)) {
-			z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
-			return;
+		if (stbi__zeof(z)) {
+			// pad with zeros so a truncated stream fails in the decoder, not here
+			if (z->pad_bits > z->num_bits) z->pad_bits = z->num_bits;
+			z->pad_bits += 8;
+		} else {
+			z->code_buffer |= (stbi__uint64)*z->zbuffer++ << z->num_bits;
 		}
-		z->code_buffer |= (unsigned int)stbi__zget8(z) << z->num_bits;
 		z->num_bits += 8;
-	} while (z->num_bits <= 24);
+	} while (z->num_bits <= 56);
+}
+
+// true if the byte at the bottom of the (byte-aligned) bit buffer is padding, not input
+stbi_inline static int stbi__zpadded(stbi__zbuf *z)
+{
+	return z->num_bits <= z->pad_bits;
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
 	unsigned int k;
 	if (z->num_bits < n) stbi__fill_bits(z);
-	k = z->code_buffer & ((1 << n) - 1);
+	k = (unsigned int)(z->code_buffer & ((1 << n) - 1));
 	z->code_buffer >>= n;
 	z->num_bits -= n;
 	return k;
@@ -4145,7 +5579,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
 	int b, s, k;
 	// not resolved by fast table, so compute it the slow way
 	// use jpeg approach, which requires MSbits at top
-	k = stbi__bit_reverse(a->code_buffer, 16);
+	k = stbi__bit_reverse((int)(a->code_buffer & 0xffff), 16);
 	for (s = STBI__ZFAST_BITS + 1; ; ++s)
 		if (k < z->maxcode[s])
 			break;
@@ -4168,7 +5602,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
 		}
 		stbi__fill_bits(a);
 	}
-	b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+	b = z->fast[(int)(a->code_buffer & STBI__ZFAST_MASK)];
 	if (b) {
 		s = b >> 9;
 		a->code_buffer >>= s;
@@ -4248,8 +5682,20 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
 			}
 			p = (stbi_uc *)(zout - dist);
 			if (dist == 1) { // run of one byte; common in images.
-				stbi_uc v = *p;
-				if (len) { do *zout++ = v; while (--len); }
+				memset(zout, *p, len);
+				zout += len;
+			}
+			else if (dist >= 8 && a->zout_end - zout >= len + 8) {
+				// copy 8 bytes at a time. a chunk never reads bytes it hasn't
+				// written yet since dist >= 8; the last one may run up to 7 bytes
+				// past the match, which later output overwrites
+				char *end = zout + len;
+				do {
+					memcpy(zout, p, 8);
+					zout += 8;
+					p += 8;
+				} while (zout < end);
+				zout = end;
 			}
 			else {
 				if (len) { do *zout++ = *p++; while (--len); }
@@ -4319,24 +5765,42 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
 		stbi__zreceive(a, a->num_bits & 7); // discard
 	 // drain the bit-packed data into header
 	k = 0;
-	while (a->num_bits > 0) {
+	while (a->num_bits > 0 && k < 4) {
+		if (stbi__zpadded(a)) return stbi__err("read past buffer", "Corrupt PNG");
 		header[k++] = (stbi_uc)(a->code_buffer & 255); // suppress MSVC run-time check
 		a->code_buffer >>= 8;
 		a->num_bits -= 8;
 	}
 	if (a->num_bits < 0) return stbi__err("zlib corrupt", "Corrupt PNG");
 	// now fill header the normal way
-	while (k < 4)
+	while (k < 4) {
+		if (stbi__zeof(a)) return stbi__err("read past buffer", "Corrupt PNG");
 		header[k++] = stbi__zget8(a);
+	}
 	len = header[1] * 256 + header[0];
 	nlen = header[3] * 256 + header[2];
 	if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt", "Corrupt PNG");
-	if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer", "Corrupt PNG");
 	if (a->zout + len > a->zout_end)
 		if (!stbi__zexpand(a, a->zout, len)) return 0;
-	memcpy(a->zout, a->zbuffer, len);
-	a->zbuffer += len;
-	a->zout += len;
+	// the bit buffer can already hold the first few stored bytes; anything past
+	// the end of the block stays there for the next block header
+	while (len > 0 && a->num_bits > 0) {
+		if (stbi__zpadded(a)) return stbi__err("read past buffer", "Corrupt PNG");
+		*a->zout++ = (char)(a->code_buffer & 255);
+		a->code_buffer >>= 8;
+		a->num_bits -= 8;
+		--len;
+	}
+	while (len > 0) {
+		int n;
+		if (stbi__zeof(a)) return stbi__err("read past buffer", "Corrupt PNG");
+		n = (int)(a->zbuffer_end - a->zbuffer);
+		if (n > len) n = len;
+		memcpy(a->zout, a->zbuffer, n);
+		a->zbuffer += n;
+		a->zout += n;
+		len -= n;
+	}
 	return 1;
 }
 
@@ -4389,6 +5853,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
 	if (parse_header)
 		if (!stbi__parse_zlib_header(a)) return 0;
 	a->num_bits = 0;
+	a->pad_bits = 0;
 	a->code_buffer = 0;
 	do {
 		final = stbi__zreceive(a, 1);
@@ -4410,6 +5875,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
 			}
 			if (!stbi__parse_huffman_block(a)) return 0;
 		}
+		if (a->progress && !a->progress(a->stream_user, a->zout_start, a->zout)) return 0;
 	} while (!final);
 	return 1;
 }
@@ -4420,6 +5886,8 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
 	a->zout = obuf;
 	a->zout_end = obuf + olen;
 	a->z_expandable = exp;
+	a->refill = NULL;
+	a->progress = NULL;
 
 	return stbi__parse_zlib(a, parse_header);
 }
@@ -4542,6 +6010,18 @@ typedef struct
 	stbi__context *s;
 	stbi_uc *idata, *expanded, *out;
 	int depth;
+	int flip_vertically; // write output rows bottom to top
+	stbi_uc *dest;       // caller's buffer to unfilter into, when nothing has to
+	int dest_stride;     // happen to the pixels afterwards
+	size_t dest_size;
+	stbi__result_info *ri;
+	int premultiply;     // stbi__premultiply_on_load, unless the file is premultiplied already
+	// streaming: IDAT payloads are inflated as they're read and rows unfiltered as
+	// soon as they're complete; with premultiplication rows are handed out one behind
+	int streamed, color;
+	stbi__uint32 rows_done, rows_ready, chunk_left;
+	int has_pending;
+	stbi__pngchunk pending; // chunk header read while looking for the next IDAT
 } stbi__png;
 
 
@@ -4579,8 +6059,214 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// SIMD unfiltering for 3 and 4 byte (8-bit) and 6 and 8 byte (16-bit) pixels.
+// Sub, Avg and Paeth predict from the pixel to the left, so those go one pixel
+// per step with all of its bytes in one register; Up has no such dependency and
+// runs across the whole row. out_bpp is either bpp or, when an opaque alpha
+// channel is added on the way out, bpp plus one sample.
+
+// n is 3, 4, 6 or 8; the branches are the same for every pixel in a row
+stbi_inline static __m128i stbi__png_load_pixel(stbi_uc const *p, int n)
+{
+	int lo;
+	stbi__uint16 hi;
+	if (n == 8)
+		return _mm_loadl_epi64((__m128i const *)p);
+	if (n == 3)
+		return _mm_cvtsi32_si128(p[0] | (p[1] << 8) | (p[2] << 16));
+	memcpy(&lo, p, 4);
+	if (n == 4)
+		return _mm_cvtsi32_si128(lo);
+	memcpy(&hi, p + 4, 2);
+	return _mm_insert_epi16(_mm_cvtsi32_si128(lo), hi, 2);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int n)
+{
+	int lo;
+	stbi__uint16 hi;
+	if (n == 8) {
+		_mm_storel_epi64((__m128i *)p, v);
+		return;
+	}
+	lo = _mm_cvtsi128_si32(v);
+	if (n == 3) {
+		p[0] = (stbi_uc)lo;
+		p[1] = (stbi_uc)(lo >> 8);
+		p[2] = (stbi_uc)(lo >> 16);
+		return;
+	}
+	memcpy(p, &lo, 4);
+	if (n == 6) {
+		hi = (stbi__uint16)_mm_extract_epi16(v, 2);
+		memcpy(p + 4, &hi, 2);
+	}
+}
+
+// unfilters pixels [start, end) of a row; in_n and out_n are how many bytes to
+// move per pixel, which may be more than bpp and out_bpp (see below)
+static void stbi__png_unfilter_pixels_sse2(stbi_uc *cur, stbi_uc const *raw, stbi_uc const *prior, int filter, int start, int end, int bpp, int out_bpp, int in_n, int out_n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi32(-1);
+	__m128i alpha = _mm_slli_epi64(ones, bpp * 8);	// ones in the added alpha bytes, if any
+	__m128i a = zero, b, c = zero, d;
+	int i;
+	if (out_bpp == bpp)
+		alpha = zero;
+	if (start > 0) {
+		// pick up the left neighbours from the output; any alpha bytes in them are
+		// in lanes that don't affect the color ones
+		a = stbi__png_load_pixel(cur + (start - 1) * out_bpp, out_bpp);
+		if (filter == STBI__F_paeth) {
+			a = _mm_unpacklo_epi8(a, zero);
+			c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + (start - 1) * out_bpp, out_bpp), zero);
+		}
+	}
+	raw += start * bpp;
+	cur += start * out_bpp;
+	prior += start * out_bpp;
+	switch (filter) {
+		case STBI__F_none:
+			for (i = start; i < end; ++i, raw += bpp, cur += out_bpp)
+				stbi__png_store_pixel(cur, _mm_or_si128(stbi__png_load_pixel(raw, in_n), alpha), out_n);
+			break;
+		case STBI__F_sub:
+		case STBI__F_paeth_first: // paeth(a, 0, 0) is always a
+			for (i = start; i < end; ++i, raw += bpp, cur += out_bpp) {
+				a = _mm_add_epi8(stbi__png_load_pixel(raw, in_n), a);
+				stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), out_n);
+			}
+			break;
+		case STBI__F_up:
+			for (i = start; i < end; ++i, raw += bpp, cur += out_bpp, prior += out_bpp) {
+				d = _mm_add_epi8(stbi__png_load_pixel(raw, in_n), stbi__png_load_pixel(prior, out_n));
+				stbi__png_store_pixel(cur, _mm_or_si128(d, alpha), out_n);
+			}
+			break;
+		case STBI__F_avg:
+		case STBI__F_avg_first:
+			// pavgb rounds up, but on inverted bytes it gives ~((a + b) >> 1). keeping
+			// the left pixel inverted leaves two instructions between pixels
+			a = _mm_xor_si128(a, ones);
+			for (i = start; i < end; ++i, raw += bpp, cur += out_bpp, prior += out_bpp) {
+				b = filter == STBI__F_avg ? _mm_xor_si128(stbi__png_load_pixel(prior, out_n), ones) : ones;
+				a = _mm_sub_epi8(_mm_avg_epu8(a, b), stbi__png_load_pixel(raw, in_n));
+				stbi__png_store_pixel(cur, _mm_or_si128(_mm_xor_si128(a, ones), alpha), out_n);
+			}
+			break;
+		case STBI__F_paeth:
+			// pixels are at most 8 bytes, so a whole one fits in 16-bit lanes
+			for (i = start; i < end; ++i, raw += bpp, cur += out_bpp, prior += out_bpp) {
+				__m128i pa, pb, pc, not_a, use_c;
+				b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior, out_n), zero);
+				pa = _mm_sub_epi16(b, c);	// p - a
+				pb = _mm_sub_epi16(a, c);	// p - b
+				pc = _mm_add_epi16(pa, pb);	// p - c
+				pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+				pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+				pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+				not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+				use_c = _mm_cmpgt_epi16(pb, pc);
+				d = _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, b));
+				d = _mm_or_si128(_mm_and_si128(not_a, d), _mm_andnot_si128(not_a, a));
+				d = _mm_add_epi8(stbi__png_load_pixel(raw, in_n), _mm_packus_epi16(d, d));
+				stbi__png_store_pixel(cur, _mm_or_si128(d, alpha), out_n);
+				a = _mm_unpacklo_epi8(d, zero);
+				c = b;
+			}
+			break;
+	}
+}
+
+static void stbi__png_unfilter_up_sse2(stbi_uc *cur, stbi_uc const *raw, stbi_uc const *prior, int n)
+{
+	int k = 0;
+	for (; k + 16 <= n; k += 16) {
+		__m128i r = _mm_loadu_si128((__m128i const *)(raw + k));
+		__m128i b = _mm_loadu_si128((__m128i const *)(prior + k));
+		_mm_storeu_si128((__m128i *)(cur + k), _mm_add_epi8(r, b));
+	}
+	for (; k < n; ++k)
+		cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+#ifdef STBI__AVX2
+static STBI__AVX2_TARGET void stbi__png_unfilter_up_avx2(stbi_uc *cur, stbi_uc const *raw, stbi_uc const *prior, int n)
+{
+	int k = 0;
+	for (; k + 32 <= n; k += 32) {
+		__m256i r = _mm256_loadu_si256((__m256i const *)(raw + k));
+		__m256i b = _mm256_loadu_si256((__m256i const *)(prior + k));
+		_mm256_storeu_si256((__m256i *)(cur + k), _mm256_add_epi8(r, b));
+	}
+	_mm256_zeroupper();
+	stbi__png_unfilter_up_sse2(cur + k, raw + k, prior + k, n - k);
+}
+#endif
+
+// returns 0 if the scalar code should handle the row: pixel layouts without a
+// kernel, and unfiltered rows that are already a plain copy
+static int stbi__png_unfilter_row_simd(stbi_uc *cur, stbi_uc const *raw, stbi_uc const *prior, int filter, int x, int bpp, int out_bpp)
+{
+	if (filter == STBI__F_none && bpp == out_bpp)
+		return 0;
+	if (filter == STBI__F_up && bpp == out_bpp) {
+	#ifdef STBI__AVX2
+		if (stbi__avx2_available()) {
+			stbi__png_unfilter_up_avx2(cur, raw, prior, x * bpp);
+			return 1;
+		}
+	#endif
+		stbi__png_unfilter_up_sse2(cur, raw, prior, x * bpp);
+		return 1;
+	}
+	switch (bpp * 16 + out_bpp) {
+		case 0x33: case 0x34: case 0x44: case 0x66: case 0x68: case 0x88:
+			// 3 and 6 byte pixels move as 4 and 8 bytes. the spare bytes belong to the
+			// next pixel, which hasn't been written yet, or get overwritten with alpha;
+			// reads of the previous row stay inside it the same way. only the last pixel
+			// of a row needs exact sizes, since rows may sit in a caller's buffer
+			stbi__png_unfilter_pixels_sse2(cur, raw, prior, filter, 0, x - 1, bpp, out_bpp, bpp == 3 ? 4 : bpp == 6 ? 8 : bpp,
+				out_bpp == 3 ? 4 : out_bpp == 6 ? 8 : out_bpp);
+			stbi__png_unfilter_pixels_sse2(cur, raw, prior, filter, x - 1, x, bpp, out_bpp, bpp, out_bpp);
+			return 1;
+	}
+	return 0;
+}
+#endif
+
+// converts a row of 16-bit samples from big-endian to platform-native
+static void stbi__png_native16_row(stbi_uc *p, stbi__uint32 n)
+{
+	stbi__uint16 *p16 = (stbi__uint16 *)p;
+	stbi__uint32 i = 0;
+#ifdef STBI_SSE2
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((__m128i const *)(p + i * 2));
+		_mm_storeu_si128((__m128i *)(p + i * 2), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+#endif
+	for (; i < n; ++i)
+		p16[i] = (stbi__uint16)((p[i * 2] << 8) | p[i * 2 + 1]);
+}
+
+// puts a row that is no longer needed as the predictor of the next into its final form
+static void stbi__png_finish_row(stbi_uc *row, stbi__uint32 x, int out_n, int depth, int premultiply)
+{
+	if (depth == 16) {
+		stbi__png_native16_row(row, x * out_n);
+		if (premultiply) stbi__premultiply_alpha16((stbi__uint16 *)row, x, out_n);
+	}
+	else if (premultiply) {
+		stbi__premultiply_alpha(row, x, out_n, 0);
+	}
+}
+
 // create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// rows [first_row, end_row) only; later ranges continue in the same output
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip, stbi__uint32 first_row, stbi__uint32 end_row)
 {
 	int bytes = (depth == 16 ? 2 : 1);
 	stbi__context *s = a->s;
@@ -4592,22 +6278,34 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 	int output_bytes = out_n * bytes;
 	int filter_bytes = img_n * bytes;
 	int width = x;
+	// only files with an alpha channel; tRNS alpha is handled with the transparency
+	int premultiply = a->premultiply && (img_n == 2 || img_n == 4);
+#ifdef STBI_SSE2
+	int simd = depth >= 8 && stbi__sse2_available();
+#endif
 
 	STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
-	a->out = (stbi_uc *)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-	if (!a->out) return stbi__err("outofmem", "Out of memory");
+	if (a->dest) {
+		a->out = a->dest;
+		stride = a->dest_stride;
+	}
+	else if (first_row == 0) {
+		a->out = (stbi_uc *)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+		if (!a->out) return stbi__err("outofmem", "Out of memory");
+	}
 
 	if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
 	img_width_bytes = (((img_n * x * depth) + 7) >> 3);
-	img_len = (img_width_bytes + 1) * y;
+	img_len = (img_width_bytes + 1) * end_row;
 
 	// we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
 	// but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
 	// so just check for raw_len < img_len always.
 	if (raw_len < img_len) return stbi__err("not enough pixels", "Corrupt PNG");
+	raw += (img_width_bytes + 1) * first_row;
 
-	for (j = 0; j < y; ++j) {
-		stbi_uc *cur = a->out + stride * j;
+	for (j = first_row; j < end_row; ++j) {
+		stbi_uc *cur = a->out + stride * (flip ? y - 1 - j : j);
 		stbi_uc *prior;
 		int filter = *raw++;
 
@@ -4620,11 +6318,22 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			filter_bytes = 1;
 			width = img_width_bytes;
 		}
-		prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
+		prior = flip ? cur + stride : cur - stride; // bugfix: need to compute this after 'cur +=' computation above
 
 		// if first row, use special filter that doesn't sample previous row
 		if (j == 0) filter = first_row_filter[filter];
 
+	#ifdef STBI_SSE2
+		if (simd && stbi__png_unfilter_row_simd(cur, raw, prior, filter, x, filter_bytes, output_bytes)) {
+			raw += x * filter_bytes;
+			// the previous row is no longer needed as a predictor; finish it while
+			// it's still in the cache
+			if (j > 0)
+				stbi__png_finish_row(a->out + stride * (flip ? y - j : j - 1), x, out_n, depth, premultiply);
+			continue;
+		}
+	#endif
+
 		// handle first byte explicitly
 		for (k = 0; k < filter_bytes; ++k) {
 			switch (filter) {
@@ -4699,21 +6408,23 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			// the loop above sets the high byte of the pixels' alpha, but for
 			// 16 bit png files we also need the low byte set. we'll do that here.
 			if (depth == 16) {
-				cur = a->out + stride * j; // start at the beginning of the row again
+				cur = a->out + stride * (flip ? y - 1 - j : j); // start at the beginning of the row again
 				for (i = 0; i < x; ++i, cur += output_bytes) {
 					cur[filter_bytes + 1] = 255;
 				}
 			}
 		}
+		if (j > 0)
+			stbi__png_finish_row(a->out + stride * (flip ? y - j : j - 1), x, out_n, depth, premultiply);
 	}
 
 	// we make a separate pass to expand bits to pixels; for performance,
 	// this could run two scanlines behind the above code, so it won't
 	// intefere with filtering but will still be in the cache.
 	if (depth < 8) {
-		for (j = 0; j < y; ++j) {
-			stbi_uc *cur = a->out + stride * j;
-			stbi_uc *in = a->out + stride * j + x * out_n - img_width_bytes;
+		for (j = first_row; j < end_row; ++j) {
+			stbi_uc *cur = a->out + stride * (flip ? y - 1 - j : j);
+			stbi_uc *in = cur + x * out_n - img_width_bytes;
 			// unpack 1/2/4-bit into a 8-bit buffer. allows us to keep the common 8-bit path optimal at minimal cost for 1/2/4-bit
 			// png guarante byte alignment, if width is not multiple of 8/4/2 we'll decode dummy trailing data that will be skipped in the later loop
 			stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
@@ -4764,7 +6475,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			if (img_n != out_n) {
 				int q;
 				// insert alpha = 255
-				cur = a->out + stride * j;
+				cur = a->out + stride * (flip ? y - 1 - j : j);
 				if (img_n == 1) {
 					for (q = x - 1; q >= 0; --q) {
 						cur[q * 2 + 1] = 255;
@@ -4783,17 +6494,10 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
 			}
 		}
 	}
-	else if (depth == 16) {
-		// force the image data from big-endian to platform-native.
-		// this is done in a separate pass due to the decoding relying
-		// on the data being untouched, but could probably be done
-		// per-line during decode if care is taken.
-		stbi_uc *cur = a->out;
-		stbi__uint16 *cur16 = (stbi__uint16*)cur;
-
-		for (i = 0; i < x*y*out_n; ++i, cur16++, cur += 2) {
-			*cur16 = (cur[0] << 8) | cur[1];
-		}
+	else if (end_row == y && y > 0) {
+		// rows go to platform-native byte order and are premultiplied one behind the
+		// unfiltering, since each is the predictor for the next; this leaves the last one
+		stbi__png_finish_row(a->out + stride * (flip ? 0 : y - 1), x, out_n, depth, premultiply);
 	}
 
 	return 1;
@@ -4806,7 +6510,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
 	stbi_uc *final;
 	int p;
 	if (!interlaced)
-		return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+		return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, a->flip_vertically, 0, a->s->img_y);
 
 	// de-interlacing
 	final = (stbi_uc *)stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4821,7 +6525,8 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
 		y = (a->s->img_y - yorig[p] + yspc[p] - 1) / yspc[p];
 		if (x && y) {
 			stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-			if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
+			// passes decode top-down; the scatter below does the flipping
+			if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0, 0, y)) {
 				STBI_FREE(final);
 				return 0;
 			}
@@ -4829,6 +6534,8 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
 				for (i = 0; i < x; ++i) {
 					int out_y = j * yspc[p] + yorig[p];
 					int out_x = i * xspc[p] + xorig[p];
+					if (a->flip_vertically)
+						out_y = a->s->img_y - 1 - out_y;
 					memcpy(final + out_y * a->s->img_x*out_bytes + out_x * out_bytes,
 						a->out + (j*x + i)*out_bytes, out_bytes);
 				}
@@ -4853,16 +6560,20 @@ static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
 	// already got 255 as the alpha value in the output
 	STBI_ASSERT(out_n == 2 || out_n == 4);
 
+	// premultiplied, the transparent pixels are all zero and the rest stay as they are
 	if (out_n == 2) {
 		for (i = 0; i < pixel_count; ++i) {
 			p[1] = (p[0] == tc[0] ? 0 : 255);
+			if (z->premultiply) p[0] &= p[1];
 			p += 2;
 		}
 	}
 	else {
 		for (i = 0; i < pixel_count; ++i) {
-			if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
+			if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2]) {
 				p[3] = 0;
+				if (z->premultiply) p[0] = p[1] = p[2] = 0;
+			}
 			p += 4;
 		}
 	}
@@ -4882,13 +6593,16 @@ static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int ou
 	if (out_n == 2) {
 		for (i = 0; i < pixel_count; ++i) {
 			p[1] = (p[0] == tc[0] ? 0 : 65535);
+			if (z->premultiply) p[0] &= p[1];
 			p += 2;
 		}
 	}
 	else {
 		for (i = 0; i < pixel_count; ++i) {
-			if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
+			if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2]) {
 				p[3] = 0;
+				if (z->premultiply) p[0] = p[1] = p[2] = 0;
+			}
 			p += 4;
 		}
 	}
@@ -4962,7 +6676,7 @@ static void stbi__de_iphone(stbi__png *z)
 	}
 	else {
 		STBI_ASSERT(s->img_out_n == 4);
-		if (stbi__unpremultiply_on_load) {
+		if (stbi__unpremultiply_on_load && !stbi__premultiply_on_load) {
 			// convert bgr to rgb and unpremultiply
 			for (i = 0; i < pixel_count; ++i) {
 				stbi_uc a = p[3];
@@ -4994,28 +6708,146 @@ static void stbi__de_iphone(stbi__png *z)
 
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
+#define STBI__PNG_STREAM_BUFFER  32768
+
+// picks the channel count to unfilter to, and whether that can go straight into the
+// caller's buffer: only when nothing has to happen to the pixels afterwards
+static int stbi__png_choose_output(stbi__png *z, int req_comp, int has_trans, int pal_img_n, int interlace, int is_iphone)
+{
+	stbi__context *s = z->s;
+	if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
+		s->img_out_n = s->img_n + 1;
+	else
+		s->img_out_n = s->img_n;
+	if (z->dest) {
+		stbi__result_info fit;
+		stbi__result_info_init(&fit);
+		fit.dest = z->dest;
+		fit.dest_stride = z->dest_stride;
+		fit.dest_size = z->dest_size;
+		z->dest_stride = stbi__dest_stride(&fit, s->img_x, s->img_y, req_comp);
+		if (z->dest_stride == 0) return stbi__err("buffer too small", "Image doesn't fit the destination");
+		if (z->depth == 16 || interlace || pal_img_n || has_trans || is_iphone || req_comp != s->img_out_n)
+			z->dest = NULL;
+	}
+	return 1;
+}
+
+// zlib input for a streamed PNG: the rest of the current IDAT, then the ones after it
+static int stbi__png_refill(void *user, stbi_uc **start, stbi_uc **end)
+{
+	stbi__png *z = (stbi__png *)user;
+	stbi__uint32 n;
+	while (z->chunk_left == 0) {
+		stbi__pngchunk c;
+		if (z->has_pending) return 0;
+		stbi__get32be(z->s); // CRC
+		c = stbi__get_chunk_header(z->s);
+		if (c.type != STBI__PNG_TYPE('I', 'D', 'A', 'T')) {
+			// the image data ended early; the chunk loop picks this one up
+			z->pending = c;
+			z->has_pending = 1;
+			return 0;
+		}
+		z->chunk_left = c.length;
+	}
+	n = z->chunk_left < STBI__PNG_STREAM_BUFFER ? z->chunk_left : STBI__PNG_STREAM_BUFFER;
+	if (!stbi__getn(z->s, z->idata, n)) return 0;
+	z->chunk_left -= n;
+	*start = z->idata;
+	*end = z->idata + n;
+	return 1;
+}
+
+// unfilters the rows inflated so far and hands them out
+static int stbi__png_progress(void *user, char *start, char *end)
+{
+	stbi__png *z = (stbi__png *)user;
+	stbi__context *s = z->s;
+	stbi__uint32 row_bytes = ((s->img_n * s->img_x * z->depth + 7) >> 3) + 1;
+	stbi__uint32 raw_len = (stbi__uint32)(end - start);
+	stbi__uint32 rows = raw_len / row_bytes;
+	int ok, phase;
+	if (rows > s->img_y) rows = s->img_y;
+	if (rows <= z->rows_done) return 1;
+	phase = stbi__phase_enter(STBI_PHASE_TRANSFORM);
+	ok = stbi__create_png_image_raw(z, (stbi_uc *)start, raw_len, s->img_out_n, s->img_x, s->img_y, z->depth, z->color, z->flip_vertically, z->rows_done, rows);
+	stbi__phase_leave(phase);
+	if (!ok) return 0;
+	z->rows_done = rows;
+	// the last row unfiltered is only premultiplied once the next has been
+	if (z->premultiply && (s->img_n == 2 || s->img_n == 4) && rows < s->img_y) --rows;
+	if (rows > z->rows_ready) {
+		stbi__rows_done(z->ri, z->rows_ready, rows, s->img_y);
+		z->rows_ready = rows;
+	}
+	return 1;
+}
+
+// inflates the image data starting with the IDAT whose header was just read
+static int stbi__png_stream_idat(stbi__png *z, stbi__uint32 length, int is_iphone)
+{
+	stbi__context *s = z->s;
+	stbi__zbuf a;
+	char *p;
+	int ok, phase;
+	stbi__uint32 raw_len = ((s->img_x * z->depth + 7) / 8) * s->img_y * s->img_n + s->img_y;
+
+	z->idata = (stbi_uc *)stbi__malloc(STBI__PNG_STREAM_BUFFER);
+	p = (char *)stbi__malloc(raw_len);
+	if (z->idata == NULL || p == NULL) { STBI_FREE(p); return stbi__err("outofmem", "Out of memory"); }
+	z->streamed = 1;
+	z->rows_done = z->rows_ready = 0;
+	z->chunk_left = length;
+
+	a.zbuffer = a.zbuffer_end = z->idata;
+	a.zout_start = a.zout = p;
+	a.zout_end = p + raw_len;
+	a.z_expandable = 1;
+	a.refill = stbi__png_refill;
+	a.progress = stbi__png_progress;
+	a.stream_user = z;
+	phase = stbi__phase_enter(STBI_PHASE_ENTROPY);
+	ok = stbi__parse_zlib(&a, !is_iphone);
+	stbi__phase_leave(phase);
+	z->expanded = (stbi_uc *)a.zout_start;
+	if (!ok) return 0;
+	if (z->rows_done < s->img_y) return stbi__err("not enough pixels", "Corrupt PNG");
+	return 1;
+}
+
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 {
 	stbi_uc palette[1024], pal_img_n = 0;
 	stbi_uc has_trans = 0, tc[3] = { 0 };
 	stbi__uint16 tc16[3];
 	stbi__uint32 ioff = 0, idata_limit = 0, i, pal_len = 0;
-	int first = 1, k, interlace = 0, color = 0, is_iphone = 0;
+	int first = 1, k, interlace = 0, color = 0, is_iphone = 0, ok, phase;
 	stbi__context *s = z->s;
 
 	z->expanded = NULL;
 	z->idata = NULL;
 	z->out = NULL;
+	z->streamed = 0;
+	z->has_pending = 0;
+	z->premultiply = stbi__premultiply_on_load;
 
 	if (!stbi__check_png_header(s)) return 0;
 
 	if (scan == STBI__SCAN_type) return 1;
 
 	for (;;) {
-		stbi__pngchunk c = stbi__get_chunk_header(s);
+		stbi__pngchunk c;
+		if (z->has_pending) {
+			c = z->pending;
+			z->has_pending = 0;
+		}
+		else
+			c = stbi__get_chunk_header(s);
 		switch (c.type) {
 			case STBI__PNG_TYPE('C', 'g', 'B', 'I'):
 				is_iphone = 1;
+				z->premultiply = 0; // premultiplied already
 				stbi__skip(s, c.length);
 				break;
 			case STBI__PNG_TYPE('I', 'H', 'D', 'R'): {
@@ -5038,7 +6870,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 				if (!pal_img_n) {
 					s->img_n = (color & 2 ? 3 : 1) + (color & 4 ? 1 : 0);
 					if ((1 << 30) / s->img_x / s->img_n < s->img_y) return stbi__err("too large", "Image too large to decode");
-					if (scan == STBI__SCAN_header) return 1;
+					// if SCAN_header, keep going to a tRNS too: it adds an alpha channel
 				}
 				else {
 					// if paletted, then pal_n is our final components, and
@@ -5078,6 +6910,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 				else {
 					if (!(s->img_n & 1)) return stbi__err("tRNS with alpha", "Corrupt PNG");
 					if (c.length != (stbi__uint32)s->img_n * 2) return stbi__err("bad tRNS len", "Corrupt PNG");
+					if (scan == STBI__SCAN_header) { ++s->img_n; return 1; }
 					has_trans = 1;
 					if (z->depth == 16) {
 						for (k = 0; k < s->img_n; ++k) tc16[k] = (stbi__uint16)stbi__get16be(s); // copy the values as-is
@@ -5092,7 +6925,21 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 			case STBI__PNG_TYPE('I', 'D', 'A', 'T'): {
 				if (first) return stbi__err("first not IHDR", "Corrupt PNG");
 				if (pal_img_n && !pal_len) return stbi__err("no PLTE", "Corrupt PNG");
-				if (scan == STBI__SCAN_header) { s->img_n = pal_img_n; return 1; }
+				if (scan == STBI__SCAN_header) { if (pal_img_n) s->img_n = pal_img_n; return 1; }
+				if (z->streamed) {
+					stbi__skip(s, c.length);
+					break;
+				}
+				if (z->ri->rows && z->dest && !z->idata) {
+					if (!stbi__png_choose_output(z, req_comp, has_trans, pal_img_n, interlace, is_iphone)) return 0;
+					if (z->dest && z->depth == 8) {
+						z->color = color;
+						if (!stbi__png_stream_idat(z, c.length, is_iphone)) return 0;
+						stbi__skip(s, z->chunk_left);
+						if (z->has_pending) continue; // its CRC was read already
+						break;
+					}
+				}
 				if ((int)(ioff + c.length) < (int)ioff) return 0;
 				if (ioff + c.length > idata_limit) {
 					stbi__uint32 idata_limit_old = idata_limit;
@@ -5113,37 +6960,45 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 				stbi__uint32 raw_len, bpl;
 				if (first) return stbi__err("first not IHDR", "Corrupt PNG");
 				if (scan != STBI__SCAN_load) return 1;
+				if (z->streamed) {
+					stbi__get32be(s);
+					return 1;
+				}
 				if (z->idata == NULL) return stbi__err("no IDAT", "Corrupt PNG");
 				// initial guess for decoded data size to avoid unnecessary reallocs
 				bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
 				raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+				phase = stbi__phase_enter(STBI_PHASE_ENTROPY);
 				z->expanded = (stbi_uc *)stbi_zlib_decode_malloc_guesssize_headerflag((char *)z->idata, ioff, raw_len, (int *)&raw_len, !is_iphone);
+				stbi__phase_leave(phase);
 				if (z->expanded == NULL) return 0; // zlib should set error
 				STBI_FREE(z->idata); z->idata = NULL;
-				if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
-					s->img_out_n = s->img_n + 1;
-				else
-					s->img_out_n = s->img_n;
-				if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+				if (!stbi__png_choose_output(z, req_comp, has_trans, pal_img_n, interlace, is_iphone)) return 0;
+				phase = stbi__phase_enter(STBI_PHASE_TRANSFORM);
+				ok = stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace);
+				stbi__phase_leave(phase);
+				if (!ok) return 0;
+				phase = stbi__phase_enter(STBI_PHASE_COLOR);
 				if (has_trans) {
-					if (z->depth == 16) {
-						if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
-					}
-					else {
-						if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
-					}
+					if (z->depth == 16)
+						ok = stbi__compute_transparency16(z, tc16, s->img_out_n);
+					else
+						ok = stbi__compute_transparency(z, tc, s->img_out_n);
 				}
-				if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
+				if (ok && is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
 					stbi__de_iphone(z);
-				if (pal_img_n) {
+				if (ok && pal_img_n) {
 					// pal_img_n == 3 or 4
 					s->img_n = pal_img_n; // record the actual colors we had
 					s->img_out_n = pal_img_n;
 					if (req_comp >= 3) s->img_out_n = req_comp;
-					if (!stbi__expand_png_palette(z, palette, pal_len, s->img_out_n))
-						return 0;
+					if (z->premultiply && pal_img_n == 4)
+						stbi__premultiply_alpha(palette, pal_len, 4, 0);
+					ok = stbi__expand_png_palette(z, palette, pal_len, s->img_out_n);
 				}
-				else if (has_trans) {
+				stbi__phase_leave(phase);
+				if (!ok) return 0;
+				if (!pal_img_n && has_trans) {
 					// non-paletted image with tRNS -> source image has (constant) alpha
 					++s->img_n;
 				}
@@ -5179,6 +7034,12 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
 {
 	void *result = NULL;
 	if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+	p->flip_vertically = ri->flip_vertically;
+	ri->flipped = ri->flip_vertically;
+	p->dest = ri->dest;
+	p->dest_stride = ri->dest_stride;
+	p->dest_size = ri->dest_size;
+	p->ri = ri;
 	if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp)) {
 		if (p->depth <= 8)
 			ri->bits_per_channel = 8;
@@ -5200,7 +7061,8 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
 		*y = p->s->img_y;
 		if (n) *n = p->s->img_n;
 	}
-	STBI_FREE(p->out);      p->out = NULL;
+	if (p->out != p->dest)  STBI_FREE(p->out);
+	p->out = NULL;
 	STBI_FREE(p->expanded); p->expanded = NULL;
 	STBI_FREE(p->idata);    p->idata = NULL;
 
@@ -5435,7 +7297,6 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 	int psize = 0, i, j, width;
 	int flip_vertically, pad, target;
 	stbi__bmp_data info;
-	STBI_NOTUSED(ri);
 
 	info.all_a = 255;
 	if (stbi__bmp_parse_header(s, &info) == NULL)
@@ -5443,6 +7304,11 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 
 	flip_vertically = ((int)s->img_y) > 0;
 	s->img_y = abs((int)s->img_y);
+	// rows are written straight to where they end up, so a bottom-up file that
+	// should load bottom-up is just read in order
+	if (ri->flip_vertically)
+		flip_vertically = !flip_vertically;
+	ri->flipped = ri->flip_vertically;
 
 	if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large", "Very large image (corrupt?)");
 	if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large", "Very large image (corrupt?)");
@@ -5502,6 +7368,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 		if (info.bpp == 1) {
 			for (j = 0; j < (int)s->img_y; ++j) {
 				int bit_offset = 7, v = stbi__get8(s);
+				z = (flip_vertically ? (int)s->img_y - 1 - j : j) * (int)s->img_x * target;
 				for (i = 0; i < (int)s->img_x; ++i) {
 					int color = (v >> bit_offset) & 0x1;
 					out[z++] = pal[color][0];
@@ -5519,6 +7386,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 		}
 		else {
 			for (j = 0; j < (int)s->img_y; ++j) {
+				z = (flip_vertically ? (int)s->img_y - 1 - j : j) * (int)s->img_x * target;
 				for (i = 0; i < (int)s->img_x; i += 2) {
 					int v = stbi__get8(s), v2 = 0;
 					if (info.bpp == 4) {
@@ -5566,6 +7434,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 			if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
 		}
 		for (j = 0; j < (int)s->img_y; ++j) {
+			z = (flip_vertically ? (int)s->img_y - 1 - j : j) * (int)s->img_x * target;
 			if (easy) {
 				for (i = 0; i < (int)s->img_x; ++i) {
 					unsigned char a;
@@ -5600,17 +7469,6 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 		for (i = 4 * s->img_x*s->img_y - 1; i >= 0; i -= 4)
 			out[i] = 255;
 
-	if (flip_vertically) {
-		stbi_uc t;
-		for (j = 0; j < (int)s->img_y >> 1; ++j) {
-			stbi_uc *p1 = out + j * s->img_x*target;
-			stbi_uc *p2 = out + (s->img_y - 1 - j)*s->img_x*target;
-			for (i = 0; i < (int)s->img_x*target; ++i) {
-				t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-			}
-		}
-	}
-
 	if (req_comp && req_comp != target) {
 		out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
 		if (out == NULL) return out; // stbi__convert_format frees input on failure
@@ -5783,12 +7641,12 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 	//   image data
 	unsigned char *tga_data;
 	unsigned char *tga_palette = NULL;
-	int i, j;
+	unsigned char *tga_row;
+	int i, j, tga_col = 0, tga_row_index = 0;
 	unsigned char raw_data[4] = { 0 };
 	int RLE_count = 0;
 	int RLE_repeating = 0;
 	int read_next_pixel = 1;
-	STBI_NOTUSED(ri);
 	STBI_NOTUSED(tga_x_origin); // @TODO
 	STBI_NOTUSED(tga_y_origin); // @TODO
 
@@ -5801,6 +7659,10 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 		tga_is_RLE = 1;
 	}
 	tga_inverted = 1 - ((tga_inverted >> 5) & 1);
+	// rows are written straight to where they end up
+	if (ri->flip_vertically)
+		tga_inverted = !tga_inverted;
+	ri->flipped = ri->flip_vertically;
 
 	//   If I'm paletted, then I'll use the number of bits from the palette
 	if (tga_indexed) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
@@ -5861,6 +7723,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 			}
 		}
 		//   load the data
+		tga_row = tga_data + (tga_inverted ? tga_height - 1 : 0) * tga_width * tga_comp;
 		for (i = 0; i < tga_width * tga_height; ++i) {
 			//   if I'm in RLE mode, do I need to get a RLE stbi__pngchunk?
 			if (tga_is_RLE) {
@@ -5909,33 +7772,28 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 
 			// copy data
 			for (j = 0; j < tga_comp; ++j)
-				tga_data[i*tga_comp + j] = raw_data[j];
+				tga_row[tga_col * tga_comp + j] = raw_data[j];
+			if (++tga_col == tga_width) {
+				tga_col = 0;
+				if (++tga_row_index < tga_height)
+					tga_row = tga_data + (tga_inverted ? tga_height - 1 - tga_row_index : tga_row_index) * tga_width * tga_comp;
+			}
 
 			//   in case we're in RLE mode, keep counting down
 			--RLE_count;
 		}
-		//   do I need to invert the image?
-		if (tga_inverted) {
-			for (j = 0; j * 2 < tga_height; ++j) {
-				int index1 = j * tga_width * tga_comp;
-				int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-				for (i = tga_width * tga_comp; i > 0; --i) {
-					unsigned char temp = tga_data[index1];
-					tga_data[index1] = tga_data[index2];
-					tga_data[index2] = temp;
-					++index1;
-					++index2;
-				}
-			}
-		}
 		//   clear my palette, if I had one
 		if (tga_palette != NULL) {
 			STBI_FREE(tga_palette);
 		}
 	}
 
-	// swap RGB - if the source data was RGB16, it already is in the right order
-	if (tga_comp >= 3 && !tga_rgb16) {
+	// swap RGB - if the source data was RGB16, it already is in the right order.
+	// premultiplying does the swap as it goes
+	if (stbi__premultiply_on_load && (tga_comp == 2 || tga_comp == 4)) {
+		stbi__premultiply_alpha(tga_data, (stbi__uint32)tga_width * tga_height, tga_comp, tga_comp == 4);
+	}
+	else if (tga_comp >= 3 && !tga_rgb16) {
 		unsigned char* tga_pixel = tga_data;
 		for (i = 0; i < tga_width * tga_height; ++i) {
 			unsigned char temp = tga_pixel[0];
@@ -6705,42 +8563,47 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
 	}
 	else {
 		// second frame - how do we dispose of the previous one?
+		// everything it drew or could have disposed of lies in its own rectangle, still in g
+		int x0 = g->start_x / 4, x1 = g->max_x / 4;
+		int y0 = g->start_y / g->line_size, y1 = g->max_y / g->line_size;
+		int row;
 		dispose = (g->eflags & 0x1C) >> 2;
-		pcount = g->w * g->h;
 
 		if ((dispose == 3) && (two_back == 0)) {
 			dispose = 2; // if I don't have an image to revert back to, default to the old background
 		}
 
-		if (dispose == 3) { // use previous graphic
-			for (pi = 0; pi < pcount; ++pi) {
-				if (g->history[pi]) {
-					memcpy(&g->out[pi * 4], &two_back[pi * 4], 4);
+		for (row = y0; row < y1; ++row) {
+			int first = row * g->w + x0, last = row * g->w + x1;
+			if (dispose == 3) { // use previous graphic
+				for (pi = first; pi < last; ++pi) {
+					if (g->history[pi]) {
+						memcpy(&g->out[pi * 4], &two_back[pi * 4], 4);
+					}
 				}
 			}
-		}
-		else if (dispose == 2) {
-			// restore what was changed last frame to background before that frame;
-			for (pi = 0; pi < pcount; ++pi) {
-				if (g->history[pi]) {
-					memcpy(&g->out[pi * 4], &g->background[pi * 4], 4);
+			else if (dispose == 2) {
+				// restore what was changed last frame to background before that frame;
+				for (pi = first; pi < last; ++pi) {
+					if (g->history[pi]) {
+						memcpy(&g->out[pi * 4], &g->background[pi * 4], 4);
+					}
 				}
 			}
-		}
-		else {
-			// This is a non-disposal case eithe way, so just
-			// leave the pixels as is, and they will become the new background
-			// 1: do not dispose
-			// 0:  not specified.
-		}
+			else {
+				// This is a non-disposal case eithe way, so just
+				// leave the pixels as is, and they will become the new background
+				// 1: do not dispose
+				// 0:  not specified.
+			}
 
-		// background is what out is after the undoing of the previou frame;
-		memcpy(g->background, g->out, 4 * g->w * g->h);
+			// background is what out is after the undoing of the previou frame; outside the
+			// rectangle the two already agree. clear my history at the same time
+			memcpy(&g->background[first * 4], &g->out[first * 4], 4 * (x1 - x0));
+			memset(&g->history[first], 0x00, x1 - x0);
+		}
 	}
 
-	// clear my history;
-	memset(g->history, 0x00, g->w * g->h);        // pixels that were affected previous frame
-
 	for (;;) {
 		int tag = stbi__get8(s);
 		switch (tag) {
@@ -6803,6 +8666,7 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
 						if (g->history[pi] == 0) {
 							g->pal[g->bgindex][3] = 255; // just in case it was made transparent, undo that; It will be reset next frame if need be;
 							memcpy(&g->out[pi * 4], &g->pal[g->bgindex], 4);
+							memcpy(&g->background[pi * 4], &g->pal[g->bgindex], 4); // so only the rectangle differs
 						}
 					}
 				}
@@ -6910,7 +8774,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
 				}
 				memcpy(out + ((layers - 1) * stride), u, stride);
 				if (layers >= 2) {
-					two_back = out - 2 * stride;
+					two_back = out + (layers - 2) * stride;
 				}
 
 				if (delays) {
@@ -6966,6 +8830,181 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req
 	return u;
 }
 
+// animated GIFs a frame at a time. besides the decoder's own out/background/history, the
+// stream keeps the frames one and two back for "restore previous" disposal; after the first
+// two frames each is brought up to date by copying just the rectangles that changed
+struct stbi__gif_stream
+{
+	stbi__context s;
+	stbi__gif g;
+	stbi_uc *back[2];    // frames n-1 and n-2 as of the next call, swapped each frame
+	int frames;          // returned since the start or the last rewind
+	int dirty[2][4];     // what the last two frames changed, x0 y0 x1 y1
+	int flip;            // bottom row first, whatever the calling thread's setting
+};
+
+static void stbi__gif_stream_reset(stbi_gif_stream *gs)
+{
+	STBI_FREE(gs->g.out);
+	STBI_FREE(gs->g.background);
+	STBI_FREE(gs->g.history);
+	memset(&gs->g, 0, sizeof(gs->g));
+	stbi__rewind(&gs->s);
+	gs->frames = 0;
+}
+
+static void stbi__gif_stream_copy_rect(stbi_uc *dest, stbi_uc const *src, int w, int const *rect)
+{
+	int row;
+	for (row = rect[1]; row < rect[3]; ++row)
+		memcpy(dest + (row * w + rect[0]) * 4, src + (row * w + rect[0]) * 4, 4 * (rect[2] - rect[0]));
+}
+
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y)
+{
+	stbi_gif_stream *gs = (stbi_gif_stream *)stbi__malloc(sizeof(stbi_gif_stream));
+	int w, h, comp;
+	if (!gs) return (stbi_gif_stream *)stbi__errpuc("outofmem", "Out of memory");
+	memset(gs, 0, sizeof(*gs));
+	stbi__start_mem(&gs->s, buffer, len);
+	if (!stbi__gif_test(&gs->s) || !stbi__gif_info_raw(&gs->s, &w, &h, &comp)) {
+		STBI_FREE(gs);
+		return (stbi_gif_stream *)stbi__errpuc("not GIF", "Image was not as a gif type.");
+	}
+	if (!stbi__mad3sizes_valid(4, w, h, 0)) {
+		STBI_FREE(gs);
+		return (stbi_gif_stream *)stbi__errpuc("too large", "GIF image is too large");
+	}
+	gs->back[0] = (stbi_uc *)stbi__malloc_mad3(4, w, h, 0);
+	gs->back[1] = (stbi_uc *)stbi__malloc_mad3(4, w, h, 0);
+	if (!gs->back[0] || !gs->back[1]) {
+		stbi_gif_stream_close(gs);
+		return (stbi_gif_stream *)stbi__errpuc("outofmem", "Out of memory");
+	}
+	stbi__rewind(&gs->s);
+	gs->flip = stbi__vertically_flip_on_load;
+	if (x) *x = w;
+	if (y) *y = h;
+	return gs;
+}
+
+STBIDEF void stbi_gif_stream_set_flip_vertically(stbi_gif_stream *gs, int flag_true_if_should_flip)
+{
+	gs->flip = flag_true_if_should_flip;
+}
+
+STBIDEF int stbi_gif_stream_next(stbi_gif_stream *gs, stbi_uc *dest, int dest_stride, int req_comp, int *delay_ms, int rect[4])
+{
+	stbi__gif *g = &gs->g;
+	stbi_uc *u, *t;
+	int comp, dispose, w, h, row, i, n, *d;
+	int prev[4];
+#ifdef STBI_SSE2
+	stbi__convert_row_kernel *kernel;
+#endif
+
+	if (req_comp < 1 || req_comp > 4) { stbi__err("bad req_comp", "Internal error"); return -1; }
+	// the previous frame's rectangle and disposal, which this call undoes
+	dispose = (g->eflags & 0x1C) >> 2;
+	if (gs->frames > 0) {
+		prev[0] = g->start_x / 4; prev[1] = g->start_y / g->line_size;
+		prev[2] = g->max_x / 4;   prev[3] = g->max_y / g->line_size;
+	}
+	u = stbi__gif_load_next(&gs->s, g, &comp, 4, gs->frames >= 2 ? gs->back[1] : 0);
+	if (u == (stbi_uc *)&gs->s) return 0;  // end of animated gif marker
+	if (!u) return -1;
+	w = g->w;
+	h = g->h;
+
+	// what changed since the previous frame: this frame's rectangle, plus the previous one's
+	// if it was disposed of. the first frame can touch every pixel
+	d = gs->dirty[1];
+	if (gs->frames == 0) {
+		d[0] = 0; d[1] = 0; d[2] = w; d[3] = h;
+	}
+	else {
+		d[0] = g->start_x / 4; d[1] = g->start_y / g->line_size;
+		d[2] = g->max_x / 4;   d[3] = g->max_y / g->line_size;
+		if ((dispose == 2 || dispose == 3) && prev[2] > prev[0] && prev[3] > prev[1]) {
+			if (d[2] <= d[0] || d[3] <= d[1]) {
+				memcpy(d, prev, sizeof(prev));
+			}
+			else {
+				if (prev[0] < d[0]) d[0] = prev[0];
+				if (prev[1] < d[1]) d[1] = prev[1];
+				if (prev[2] > d[2]) d[2] = prev[2];
+				if (prev[3] > d[3]) d[3] = prev[3];
+			}
+		}
+	}
+
+	// the older frame buffer becomes this frame. it already holds frame n-2, which differs from
+	// this one only where the last two frames changed something
+	t = gs->back[1];
+	if (gs->frames < 2) {
+		memcpy(t, u, 4 * w * h);
+	}
+	else {
+		stbi__gif_stream_copy_rect(t, u, w, gs->dirty[0]);
+		stbi__gif_stream_copy_rect(t, u, w, gs->dirty[1]);
+	}
+	gs->back[1] = gs->back[0];
+	gs->back[0] = t;
+	memcpy(gs->dirty[0], gs->dirty[1], sizeof(gs->dirty[0]));
+	++gs->frames;
+
+	// composited frame out to dest, whole: dest may be one of several the caller cycles through
+	if (dest_stride == 0) dest_stride = w * req_comp;
+#ifdef STBI_SSE2
+	kernel = stbi__convert_kernel_sse2(4, req_comp);
+#endif
+	for (row = 0; row < h; ++row) {
+		stbi_uc const *src = u + row * w * 4;
+		stbi_uc *out = dest + (size_t)(gs->flip ? h - 1 - row : row) * dest_stride;
+		if (req_comp == 4) {
+			memcpy(out, src, 4 * w);
+			continue;
+		}
+		i = 0;
+	#ifdef STBI_SSE2
+		if (kernel) i = kernel(out, src, w);
+	#endif
+		for (; i < w; ++i) {
+			n = i * req_comp;
+			switch (req_comp) {
+				case 1: out[n] = stbi__compute_y(src[i * 4], src[i * 4 + 1], src[i * 4 + 2]); break;
+				case 2: out[n] = stbi__compute_y(src[i * 4], src[i * 4 + 1], src[i * 4 + 2]); out[n + 1] = src[i * 4 + 3]; break;
+				default: out[n] = src[i * 4]; out[n + 1] = src[i * 4 + 1]; out[n + 2] = src[i * 4 + 2]; break;
+			}
+		}
+	}
+
+	if (delay_ms) *delay_ms = g->delay;
+	if (rect) {
+		d = gs->dirty[0];
+		rect[0] = d[0];
+		rect[1] = gs->flip ? h - d[3] : d[1];
+		rect[2] = d[2] - d[0];
+		rect[3] = d[3] - d[1];
+	}
+	return 1;
+}
+
+STBIDEF int stbi_gif_stream_rewind(stbi_gif_stream *gs)
+{
+	stbi__gif_stream_reset(gs);
+	return 1;
+}
+
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *gs)
+{
+	if (!gs) return;
+	stbi__gif_stream_reset(gs);
+	STBI_FREE(gs->back[0]);
+	STBI_FREE(gs->back[1]);
+	STBI_FREE(gs);
+}
+
 static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
 	return stbi__gif_info_raw(s, x, y, comp);
@@ -7048,6 +9087,46 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
 	}
 }
 
+// converts a scanline of RGBE pixels
+static void stbi__hdr_convert_row(float *output, stbi_uc *input, int count, int req_comp)
+{
+	int i = 0;
+#ifdef STBI_SSE2
+	if (req_comp >= 3 && stbi__sse2_available()) {
+		// m * 2^(e-136), with 2^(e-136) built as two exactly representable halves so that
+		// tiny exponents don't need denormals; e == 0 is black
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 alpha = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+		const __m128 one = _mm_set1_ps(1.0f);
+		// the 3-channel stores write a fourth float into the next pixel, so stop one short
+		int end = req_comp == 4 ? count : count - 1;
+		for (; i + 4 <= end; i += 4) {
+			__m128i rgbe = _mm_loadu_si128((__m128i const *)(input + i * 4));
+			__m128i lo = _mm_unpacklo_epi8(rgbe, zero), hi = _mm_unpackhi_epi8(rgbe, zero);
+			__m128i px[4];
+			int k;
+			px[0] = _mm_unpacklo_epi16(lo, zero);
+			px[1] = _mm_unpackhi_epi16(lo, zero);
+			px[2] = _mm_unpacklo_epi16(hi, zero);
+			px[3] = _mm_unpackhi_epi16(hi, zero);
+			for (k = 0; k < 4; ++k) {
+				__m128i e = _mm_shuffle_epi32(px[k], _MM_SHUFFLE(3, 3, 3, 3));
+				__m128i e1 = _mm_srli_epi32(e, 1);
+				__m128i e2 = _mm_sub_epi32(e, e1);
+				__m128 f1 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e1, _mm_set1_epi32(127 - 68)), 23));
+				__m128 f2 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e2, _mm_set1_epi32(127 - 68)), 23));
+				__m128 v = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(px[k]), f1), f2);
+				v = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(e, zero)), v);
+				v = _mm_or_ps(_mm_and_ps(alpha, one), _mm_andnot_ps(alpha, v));
+				_mm_storeu_ps(output + (i + k) * req_comp, v);
+			}
+		}
+	}
+#endif
+	for (; i < count; ++i)
+		stbi__hdr_convert(output + i * req_comp, input + i * 4, req_comp);
+}
+
 static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
 	char buffer[STBI__HDR_BUFLEN];
@@ -7165,14 +9244,20 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
 					}
 					else {
 						// Dump
-						if (count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-						for (z = 0; z < count; ++z)
-							scanline[i++ * 4 + k] = stbi__get8(s);
+						if (count == 0 || count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+						if (s->img_buffer_end - s->img_buffer >= count) {
+							// straight out of the buffer when the whole span is in it
+							for (z = 0; z < count; ++z)
+								scanline[i++ * 4 + k] = s->img_buffer[z];
+							s->img_buffer += count;
+						}
+						else
+							for (z = 0; z < count; ++z)
+								scanline[i++ * 4 + k] = stbi__get8(s);
 					}
 				}
 			}
-			for (i = 0; i < width; ++i)
-				stbi__hdr_convert(hdr_data + (j*width + i)*req_comp, scanline + i * 4, req_comp);
+			stbi__hdr_convert_row(hdr_data + j * width*req_comp, scanline, width, req_comp);
 		}
 		if (scanline)
 			STBI_FREE(scanline);
@@ -7238,7 +9323,7 @@ static int stbi__bmp_info(stbi__context *s, int *x, int *y, int *comp)
 	if (p == NULL)
 		return 0;
 	if (x) *x = s->img_x;
-	if (y) *y = s->img_y;
+	if (y) *y = abs((int)s->img_y); // negative for top-down files
 	if (comp) {
 		if (info.bpp == 24 && info.ma == 0xff000000)
 			*comp = 3;
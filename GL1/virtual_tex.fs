@@ -0,0 +1,29 @@
+#version 330 core
+out vec4 fragColor;
+in vec2 texCoord;
+
+uniform sampler2D vtCache;			// physical tile cache
+uniform sampler2D vtIndirection;	// one texel per mip-0 page: (slot x, slot y, mip)
+uniform vec2 vtSize;				// virtual texture size in texels
+uniform vec2 vtSlots;				// cache size in slots
+uniform float vtTileSize;
+uniform float vtBorder;
+
+vec4 sampleVirtual(vec2 uv)
+{
+	uv = fract(uv);
+	vec3 page = floor(texture(vtIndirection, uv).rgb * 255.0 + 0.5);
+
+	// Position inside the resident page, at that page's mip
+	vec2 mipSize = max(floor(vtSize / exp2(page.b)), vec2(1.0));
+	vec2 inPage = fract(uv * mipSize / vtTileSize);
+
+	float slotSide = vtTileSize + 2.0 * vtBorder;
+	vec2 texel = page.rg * slotSide + vtBorder + inPage * vtTileSize;
+	return textureLod(vtCache, texel / (vtSlots * slotSide), 0.0);
+}
+
+void main()
+{
+	fragColor = sampleVirtual(texCoord);
+}
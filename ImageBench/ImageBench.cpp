@@ -0,0 +1,1020 @@
+// Image decode benchmarks for the GL1 texture pipeline.
+// Usage: ImageBench [scaling|io|jpeg|restart|scaled|into|stream|gif|tilecache|inflate|unfilter|hdr|convert|report] [image files...]
+//   scaling   batch decode throughput on 1..N worker threads (default)
+//   io        stdio (stbi_load) vs. memory-mapped file input
+//   jpeg      single-threaded JPEG decode, SSE2 vs. AVX2 kernels
+//   restart   one JPEG at a time, restart intervals split across 1..N threads
+//   scaled    JPEG decode at 1/1, 1/2, 1/4 and 1/8 size
+//   into      decode to a fresh allocation and copy out vs. decode into a reused buffer
+//   stream    decode while the file arrives at download speed vs. after it has arrived
+//   gif       animated GIF frames all at once vs. one at a time into a reused buffer
+//   tilecache virtual texture page cache: checks hits, misses, eviction, the pinned coarsest
+//             page and indirection updates, then times a camera flying over a 16k texture
+//   inflate   zlib decompression of PNG image data, apart from unfiltering
+//   unfilter  PNG decode of generated images, one row filter type at a time
+//   hdr       Radiance .hdr decode to float and 8-bit, and 8-bit images loaded as float
+//   convert   channel count conversion (req_comp) on generated images of several sizes
+//   report    generated images plus the files: throughput, allocations and time per decode
+//             phase, per image and per format, as JSON on stdout for tracking regressions
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DecodeArena.h"
+#include "ImageLoader.h"
+#include "MappedFile.h"
+#include "stb_image.h"
+#include "StreamDecoder.h"
+#include "ThreadPool.h"
+#include "TileCache.h"
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// keeps the read loops from being optimized away
+	volatile unsigned sink;
+
+	char const * const DEFAULT_CORPUS[] = { "../GL1/ping.png", "../GL1/ping.jpg", "../GL1/wall.jpg", "../GL1/awesomeface.png" };
+
+	struct CorpusFile
+	{
+		std::string path;
+		std::vector<unsigned char> bytes;
+	};
+
+	double msSince(Clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(Clock::now() - start).count();
+	}
+
+	bool readCorpus(std::vector<std::string> const & paths, std::vector<CorpusFile> & corpus)
+	{
+		for (std::string const & path : paths) {
+			std::ifstream in(path, std::ios::binary);
+			if (!in) {
+				std::printf("can't read \"%s\"\n", path.c_str());
+				return false;
+			}
+			CorpusFile file;
+			file.path = path;
+			file.bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			corpus.push_back(std::move(file));
+		}
+		return !corpus.empty();
+	}
+
+	// Decodes the corpus (repeated to keep every thread busy) from memory on 1..N threads
+	int runScaling(std::vector<CorpusFile> const & corpus)
+	{
+		unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+		size_t repeats = std::max<size_t>(1, (8 * maxThreads + corpus.size() - 1) / corpus.size());
+		std::vector<ImageSource> batch;
+		for (size_t r(0); r < repeats; ++r)
+			for (CorpusFile const & file : corpus)
+				batch.push_back(ImageSource::FromMemory(file.bytes.data(), file.bytes.size()));
+
+		std::printf("batch decode: %zu images, 1..%u threads\n", batch.size(), maxThreads);
+		std::printf("%8s %10s %10s %10s %9s %11s\n", "threads", "ms", "images/s", "MPix/s", "speedup", "efficiency");
+		double baseline = 0.0;
+		for (unsigned threads(1); threads <= maxThreads; ++threads) {
+			ThreadPool pool(threads);
+			ImageLoader loader(pool);
+			std::atomic<unsigned long long> pixels(0);
+			std::atomic<unsigned> failures(0);
+			auto count = [&](size_t, LoadedImage & img) {
+				if (img.pixels == nullptr)
+					++failures;
+				pixels += static_cast<unsigned long long>(img.width) * img.height;
+			};
+
+			loader.LoadMany(batch, 4, true, count);	// warm-up, which also sizes the arenas
+			pixels = 0;
+			DecodeArena::ResetTotals();
+			Clock::time_point start = Clock::now();
+			loader.LoadMany(batch, 4, true, count);
+			double ms = msSince(start);
+			if (threads == 1)
+				baseline = ms;
+			std::printf("%8u %10.2f %10.1f %10.2f %8.2fx %10.0f%%\n", threads, ms, batch.size() * 1000.0 / ms, pixels / (ms * 1000.0),
+				baseline / ms, 100.0 * baseline / (ms * threads));
+			if (failures)
+				std::printf("  %u decodes failed\n", failures.load());
+		}
+
+		DecodeAllocStats allocs = DecodeArena::Totals();
+		if (allocs.images) {
+			std::printf("decoder allocations per image: %.1f, reallocs %.1f (%.1f in place), heap fallbacks %.2f; peak %.1f MB per decode\n",
+				static_cast<double>(allocs.allocations) / allocs.images, static_cast<double>(allocs.reallocs) / allocs.images,
+				static_cast<double>(allocs.reallocsInPlace) / allocs.images, static_cast<double>(allocs.heapFallbacks) / allocs.images,
+				allocs.peakBytes / 1048576.0);
+		}
+		return 0;
+	}
+
+	// Reads and decodes every file straight from disk, once through stb_image's stdio
+	// path and once through a sequential mapping handed over as a memory context
+	int runIo(std::vector<CorpusFile> const & corpus)
+	{
+		int const iterations = 20;
+		std::printf("file input: %d iterations per file, MB/s of encoded bytes\n", iterations);
+		std::printf("%-28s %10s %12s %12s %12s %12s\n", "file", "KB", "read stdio", "read mmap", "load stdio", "load mmap");
+		for (CorpusFile const & file : corpus) {
+			double mb = file.bytes.size() / 1048576.0;
+			std::vector<unsigned char> buffer(file.bytes.size());
+			unsigned checksum = 0;
+
+			Clock::time_point start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				FILE * f = std::fopen(file.path.c_str(), "rb");
+				if (f == NULL)
+					return -1;
+				checksum += static_cast<unsigned>(std::fread(buffer.data(), 1, buffer.size(), f));
+				std::fclose(f);
+			}
+			double readStdio = iterations * mb / (msSince(start) / 1000.0);
+
+			start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				MappedFile mapped;
+				if (!mapped.Open(file.path.c_str(), MappedFile::ACCESS_SEQUENTIAL))
+					return -1;
+				// touch every page, as a decoder would
+				for (size_t offset(0); offset < mapped.Size(); offset += 4096)
+					checksum += mapped.Data()[offset];
+			}
+			double readMapped = iterations * mb / (msSince(start) / 1000.0);
+
+			start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				int w, h, n;
+				stbi_set_flip_vertically_on_load_thread(1);
+				stbi_image_free(stbi_load(file.path.c_str(), &w, &h, &n, 0));
+			}
+			double loadStdio = iterations * mb / (msSince(start) / 1000.0);
+
+			start = Clock::now();
+			for (int i(0); i < iterations; ++i)
+				LoadedImage img = ImageLoader::Load(ImageSource::FromFile(file.path), 0, true);
+			double loadMapped = iterations * mb / (msSince(start) / 1000.0);
+
+			sink = checksum;
+			std::printf("%-28s %10.1f %12.1f %12.1f %12.2f %12.2f\n", file.path.c_str(), file.bytes.size() / 1024.0,
+				readStdio, readMapped, loadStdio, loadMapped);
+		}
+		return 0;
+	}
+
+	// Decodes each JPEG in the corpus from memory with the AVX2 kernels switched off
+	// and on. Non-JPEG files are skipped.
+	int runJpeg(std::vector<CorpusFile> const & corpus)
+	{
+		int const iterations = 50;
+		std::printf("jpeg decode: %d iterations per file, MPix/s\n", iterations);
+		std::printf("%-28s %12s %10s %10s %9s\n", "file", "size", "SSE2", "AVX2", "speedup");
+		for (CorpusFile const & file : corpus) {
+			if (file.bytes.size() < 2 || file.bytes[0] != 0xFF || file.bytes[1] != 0xD8)
+				continue;
+			int w = 0, h = 0, n = 0;
+			double mpix[2];
+			for (int avx2(0); avx2 < 2; ++avx2) {
+				stbi_set_avx2_enabled(avx2);
+				// RGBA output is what the texture path asks for, and the only layout
+				// the SIMD color conversion handles
+				stbi_image_free(stbi_load_from_memory(file.bytes.data(), static_cast<int>(file.bytes.size()), &w, &h, &n, 4));
+				Clock::time_point start = Clock::now();
+				for (int i(0); i < iterations; ++i) {
+					unsigned char * pixels = stbi_load_from_memory(file.bytes.data(), static_cast<int>(file.bytes.size()), &w, &h, &n, 4);
+					if (pixels == NULL)
+						return -1;
+					sink = pixels[0];
+					stbi_image_free(pixels);
+				}
+				mpix[avx2] = static_cast<double>(w) * h * iterations / (msSince(start) * 1000.0);
+			}
+			stbi_set_avx2_enabled(1);
+			char size[32];
+			std::snprintf(size, sizeof(size), "%dx%d", w, h);
+			std::printf("%-28s %12s %10.2f %10.2f %8.2fx\n", file.path.c_str(), size, mpix[0], mpix[1], mpix[1] / mpix[0]);
+		}
+		return 0;
+	}
+
+	// Decodes each JPEG on its own, letting stb_image spread its restart intervals over
+	// 1..N threads. Files without restart markers decode serially at every thread count.
+	int runRestart(std::vector<CorpusFile> const & corpus)
+	{
+		int const iterations = 20;
+		unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+		std::printf("restart-interval decode: %d iterations per file, 1..%u threads, MPix/s\n", iterations, maxThreads);
+		for (CorpusFile const & file : corpus) {
+			if (file.bytes.size() < 2 || file.bytes[0] != 0xFF || file.bytes[1] != 0xD8)
+				continue;
+			std::printf("%s\n", file.path.c_str());
+			double baseline = 0.0;
+			for (unsigned threads(1); threads <= maxThreads; ++threads) {
+				// the calling thread works too, so the pool only needs the others
+				ThreadPool pool(threads - 1);
+				ImageLoader::EnableParallelJpeg(threads > 1 ? &pool : nullptr);
+				int w = 0, h = 0;
+				Clock::time_point start = Clock::now();
+				for (int i(0); i < iterations; ++i) {
+					LoadedImage img = ImageLoader::Load(ImageSource::FromMemory(file.bytes.data(), file.bytes.size()), 4, true);
+					if (img.pixels == nullptr)
+						return -1;
+					w = img.width;
+					h = img.height;
+				}
+				double ms = msSince(start);
+				ImageLoader::EnableParallelJpeg(nullptr);
+				if (threads == 1)
+					baseline = ms;
+				std::printf("%8u %10.2f %8.2fx\n", threads, static_cast<double>(w) * h * iterations / (ms * 1000.0), baseline / ms);
+			}
+		}
+		return 0;
+	}
+
+	// Decodes each JPEG at full size and through the reduced IDCTs; what a low mip costs
+	// when it's decoded directly instead of downsampled from the full image
+	int runScaled(std::vector<CorpusFile> const & corpus)
+	{
+		int const iterations = 20;
+		std::printf("scaled jpeg decode: %d iterations per file, ms per decode\n", iterations);
+		std::printf("%-28s %12s %10s %10s %10s %10s\n", "file", "size", "1/1", "1/2", "1/4", "1/8");
+		for (CorpusFile const & file : corpus) {
+			if (file.bytes.size() < 2 || file.bytes[0] != 0xFF || file.bytes[1] != 0xD8)
+				continue;
+			int fullW = 0, fullH = 0;
+			double ms[4];
+			for (int shift(0); shift < 4; ++shift) {
+				stbi_set_jpeg_scale_denom_thread(1 << shift);
+				Clock::time_point start = Clock::now();
+				for (int i(0); i < iterations; ++i) {
+					int w, h, n;
+					unsigned char * pixels = stbi_load_from_memory(file.bytes.data(), static_cast<int>(file.bytes.size()), &w, &h, &n, 4);
+					if (pixels == NULL)
+						return -1;
+					if (shift == 0) {
+						fullW = w;
+						fullH = h;
+					}
+					sink = pixels[0];
+					stbi_image_free(pixels);
+				}
+				ms[shift] = msSince(start) / iterations;
+			}
+			stbi_set_jpeg_scale_denom_thread(1);
+			char size[32];
+			std::snprintf(size, sizeof(size), "%dx%d", fullW, fullH);
+			std::printf("%-28s %12s %10.2f %10.2f %10.2f %10.2f\n", file.path.c_str(), size, ms[0], ms[1], ms[2], ms[3]);
+		}
+		return 0;
+	}
+
+	// Fills a reused staging buffer the old way (stbi_load, then copy) and by decoding
+	// straight into it; the difference is the allocation and the extra pass over the pixels
+	int runInto(std::vector<CorpusFile> const & corpus)
+	{
+		int const iterations = 20;
+		std::printf("decode into a caller's buffer: %d iterations per file, ms per decode\n", iterations);
+		std::printf("%-28s %12s %10s %10s %8s\n", "file", "size", "load+copy", "into", "speedup");
+		std::vector<unsigned char> staging;
+		for (CorpusFile const & file : corpus) {
+			unsigned char const * bytes = file.bytes.data();
+			int len = static_cast<int>(file.bytes.size());
+			int w, h, n;
+			if (!stbi_info_from_memory(bytes, len, &w, &h, &n))
+				continue;
+			size_t size = static_cast<size_t>(w) * h * 4;
+			staging.resize(size);
+
+			Clock::time_point start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				unsigned char * pixels = stbi_load_from_memory(bytes, len, &w, &h, &n, 4);
+				if (pixels == NULL)
+					return -1;
+				std::memcpy(staging.data(), pixels, size);
+				stbi_image_free(pixels);
+			}
+			double copyMs = msSince(start) / iterations;
+
+			start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				if (!stbi_load_into_from_memory(bytes, len, &w, &h, &n, 4, staging.data(), 0, size))
+					return -1;
+			}
+			double intoMs = msSince(start) / iterations;
+			sink = staging[0];
+
+			char dims[32];
+			std::snprintf(dims, sizeof(dims), "%dx%d", w, h);
+			std::printf("%-28s %12s %10.2f %10.2f %7.2fx\n", file.path.c_str(), dims, copyMs, intoMs, copyMs / intoMs);
+		}
+		return 0;
+	}
+
+	// Feeds each file to a StreamDecoder in pieces paced like a 50 Mbit/s download and reports
+	// when the first rows and the whole image were ready, against decoding once it has all arrived.
+	int runStream(std::vector<CorpusFile> const & corpus)
+	{
+		double const bytesPerMs = 50e6 / 8 / 1000;
+		size_t const pieceBytes = 16 << 10;
+		std::printf("decode while downloading at 50 Mbit/s, ms since the first byte\n");
+		std::printf("%-28s %12s %10s %10s %10s %10s %10s\n", "file", "size", "arrived", "1st rows", "streamed", "buffered", "cancel");
+		for (CorpusFile const & file : corpus) {
+			unsigned char const * bytes = file.bytes.data();
+			size_t len = file.bytes.size();
+			std::atomic<double> firstRowsMs(-1.0);
+			Clock::time_point start = Clock::now();
+			StreamDecoder decoder(4, true, [&](int, int) {
+				if (firstRowsMs.load() < 0.0)
+					firstRowsMs = msSince(start);
+			});
+			for (size_t offset(0); offset < len; offset += pieceBytes) {
+				std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<long long>(offset / bytesPerMs * 1000.0)));
+				decoder.Push(bytes + offset, std::min(pieceBytes, len - offset));
+			}
+			double arrivedMs = msSince(start);
+			decoder.Finish();
+			if (!decoder.Wait()) {
+				std::printf("%-28s %s\n", file.path.c_str(), decoder.Error());
+				continue;
+			}
+			double streamedMs = msSince(start);
+
+			Clock::time_point decodeStart = Clock::now();
+			int w, h, n;
+			unsigned char * pixels = stbi_load_from_memory(bytes, static_cast<int>(len), &w, &h, &n, 4);
+			if (pixels == NULL)
+				return -1;
+			double bufferedMs = arrivedMs + msSince(decodeStart);
+			stbi_image_free(pixels);
+
+			// Dropping a decoder a third of the way through the file has to stop it promptly, on
+			// its own thread so a decoder stuck waiting for data shows up as a failure, not a hang
+			std::unique_ptr<StreamDecoder> partial(new StreamDecoder());
+			partial->Push(bytes, len / 3);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			std::atomic<bool> dropped(false);
+			decodeStart = Clock::now();
+			std::thread([&partial, &dropped]() {
+				partial.reset();
+				dropped = true;
+			}).detach();
+			while (!dropped && msSince(decodeStart) < 5000.0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			if (!dropped) {
+				std::printf("%-28s still decoding 5 s after being dropped\n", file.path.c_str());
+				std::_Exit(-1);
+			}
+			double cancelMs = msSince(decodeStart);
+
+			char dims[32];
+			std::snprintf(dims, sizeof(dims), "%dx%d", w, h);
+			std::printf("%-28s %12s %10.2f %10.2f %10.2f %10.2f %10.2f\n", file.path.c_str(), dims, arrivedMs, firstRowsMs.load(), streamedMs, bufferedMs, cancelMs);
+		}
+		return 0;
+	}
+
+	// Animated GIFs whole (every frame in one buffer) against a frame at a time into one reused
+	// buffer: ms for all frames, peak decoder memory, and how much of each frame actually changed
+	int runGif(std::vector<CorpusFile> const & corpus)
+	{
+		std::printf("animated GIF, all frames: whole file vs. one frame at a time\n");
+		std::printf("%-28s %12s %7s %10s %10s %10s %10s %8s\n", "file", "size", "frames", "whole ms", "whole MB", "stream ms", "stream MB", "changed");
+		for (CorpusFile const & file : corpus) {
+			unsigned char const * bytes = file.bytes.data();
+			int len = static_cast<int>(file.bytes.size());
+			int w, h, frames, n;
+			int * delays = nullptr;
+
+			DecodeArena::ResetTotals();
+			Clock::time_point start = Clock::now();
+			{
+				DecodeArena::Scope scope;
+				unsigned char * pixels = stbi_load_gif_from_memory(bytes, len, &delays, &w, &h, &frames, &n, 4);
+				if (pixels == NULL)
+					continue;
+				sink = pixels[0];
+				stbi_image_free(pixels);
+				stbi_image_free(delays);
+			}
+			double wholeMs = msSince(start);
+			size_t wholePeak = DecodeArena::Totals().peakBytes;
+
+			std::vector<unsigned char> frame(static_cast<size_t>(w) * h * 4);
+			double changed = 0.0;
+			int streamed = 0;
+			DecodeArena::ResetTotals();
+			start = Clock::now();
+			{
+				DecodeArena::Scope scope;
+				stbi_gif_stream * stream = stbi_gif_stream_open_from_memory(bytes, len, &w, &h);
+				if (stream == NULL)
+					continue;
+				int delayMs, rect[4];
+				while (stbi_gif_stream_next(stream, frame.data(), 0, 4, &delayMs, rect) == 1) {
+					changed += static_cast<double>(rect[2]) * rect[3];
+					++streamed;
+				}
+				stbi_gif_stream_close(stream);
+			}
+			double streamMs = msSince(start);
+			size_t streamPeak = DecodeArena::Totals().peakBytes;
+			sink = frame[0];
+			if (streamed != frames)
+				return -1;
+
+			char dims[32];
+			std::snprintf(dims, sizeof(dims), "%dx%d", w, h);
+			std::printf("%-28s %12s %7d %10.2f %10.2f %10.2f %10.2f %7.1f%%\n", file.path.c_str(), dims, frames, wholeMs, wholePeak / 1048576.0,
+				streamMs, (streamPeak + frame.size()) / 1048576.0, 100.0 * changed / (static_cast<double>(w) * h * frames));
+		}
+		return 0;
+	}
+
+	// Checks of the virtual texture page cache, then its cost per frame for a camera moving over
+	// a 16k x 16k texture. No GL: only the page bookkeeping VirtualTexture does every frame.
+	int runTileCache()
+	{
+		int const size = 16384, tileSize = 128, slotsX = 16, slotsY = 16, frames = 10000;
+		TileCache cache(size, size, tileSize, slotsX, slotsY);
+		int const usable = slotsX * slotsY - 1;	// slot 0 holds the coarsest page for good
+		uint32_t const top = MakePageKey(cache.MipCount() - 1, 0, 0);
+		std::vector<uint32_t> entries;
+		auto check = [](bool ok, char const * what) {
+			if (!ok)
+				std::printf("tile cache: %s failed\n", what);
+			return ok;
+		};
+		auto request = [&](int mip, int first, int count) {
+			cache.BeginFrame();
+			for (int i(first); i < first + count; ++i)
+				cache.Request(MakePageKey(mip, i % cache.PagesX(mip), i / cache.PagesX(mip)));
+			return cache.Resolve(static_cast<size_t>(count)).size();
+		};
+
+		// The coarsest page is uploaded first, into slot 0, and every page falls back to it
+		bool ok = check(cache.MipCount() == 8, "mip count");
+		ok = ok && check(cache.Resolve(1).size() == 1 && cache.Lookup(top) == 0, "pinned page upload");
+		ok = ok && check(cache.BuildIndirection(entries) && entries.size() == 128u * 128u
+			&& entries[0] == (0xff000000u | (7u << 16)), "indirection fallback");
+		ok = ok && check(!cache.BuildIndirection(entries), "unchanged indirection");
+
+		// Misses fill free slots, the same pages again are hits
+		ok = ok && check(request(2, 0, 64) == 64 && cache.Stats().evictions == 0, "misses");
+		ok = ok && check(request(2, 0, 64) == 0 && cache.Stats().hits == 64, "hits");
+		ok = ok && check(cache.BuildIndirection(entries) && entries[0] == (0xff000000u | (2u << 16) | (cache.Lookup(MakePageKey(2, 0, 0)) % slotsX)
+			| (static_cast<uint32_t>(cache.Lookup(MakePageKey(2, 0, 0)) / slotsX) << 8)), "indirection update");
+
+		// Filling every slot with new pages evicts the old ones, never the pinned one
+		ok = ok && check(request(3, 0, usable) == static_cast<size_t>(usable) && cache.Stats().evictions == 64, "eviction");
+		ok = ok && check(cache.Lookup(MakePageKey(2, 0, 0)) < 0 && cache.Lookup(top) == 0, "evicted and pinned pages");
+
+		// Pages requested in the same frame are never evicted for each other: the extra ones wait
+		ok = ok && check(request(1, 0, usable + 45) == static_cast<size_t>(usable) && cache.Stats().dropped == 45, "dropped requests");
+		ok = ok && check(cache.Lookup(top) == 0, "pinned page after overflow");
+		if (!ok)
+			return -1;
+		std::printf("tile cache checks passed\n");
+
+		// A camera sliding across the texture and zooming in and out, 16 uploads a frame at most.
+		// A 1024 pixel view touches up to 17x17 pages, so the cache holds a few screens' worth.
+		int const flightSlots = 32;
+		std::printf("%dx%d texture, %d px tiles, %dx%d slots, %d frames\n", size, size, tileSize, flightSlots, flightSlots, frames);
+		std::printf("%10s %10s %10s %10s %10s %10s %12s\n", "requests", "hit %", "uploads", "evictions", "dropped", "us/frame", "indir us");
+		TileCache flight(size, size, tileSize, flightSlots, flightSlots);
+		std::vector<uint32_t> pages;
+		double requestMs = 0.0, indirectionMs = 0.0;
+		int indirectionBuilds = 0;
+		for (int frame(0); frame < frames; ++frame) {
+			float t = frame * 0.001f;
+			float u = 0.5f + 0.4f * std::sin(t * 3.0f), v = 0.5f + 0.4f * std::cos(t * 2.0f);
+			float span = 0.02f + 0.06f * (0.5f + 0.5f * std::sin(t * 0.7f));
+			// the mip VirtualTexture::Update picks for a 1024 pixel wide view of the rectangle
+			int mip = static_cast<int>(std::floor(std::log2(std::max(2.0f * span * size / 1024.0f, 1.0f))));
+
+			Clock::time_point start = Clock::now();
+			pages.clear();
+			flight.CollectFootprint(u - span, v - span, u + span, v + span, mip, pages);
+			flight.BeginFrame();
+			for (uint32_t page : pages)
+				flight.Request(page);
+			sink = static_cast<unsigned>(flight.Resolve(16).size());
+			requestMs += msSince(start);
+
+			start = Clock::now();
+			if (flight.BuildIndirection(entries)) {
+				indirectionMs += msSince(start);
+				++indirectionBuilds;
+			}
+		}
+		TileCacheStats const & stats = flight.Stats();
+		std::printf("%10u %10.1f %10u %10u %10u %10.2f %12.2f\n", stats.requests, 100.0 * stats.hits / std::max(1u, stats.requests),
+			stats.uploads, stats.evictions, stats.dropped, requestMs * 1000.0 / frames, indirectionMs * 1000.0 / std::max(1, indirectionBuilds));
+		return 0;
+	}
+
+	// Concatenates the IDAT chunks of a PNG into the zlib stream they split up
+	bool pngImageData(std::vector<unsigned char> const & bytes, std::vector<unsigned char> & zlib)
+	{
+		static unsigned char const SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		if (bytes.size() < 8 || std::memcmp(bytes.data(), SIGNATURE, 8) != 0)
+			return false;
+		size_t offset = 8;
+		while (offset + 12 <= bytes.size()) {
+			unsigned char const * chunk = bytes.data() + offset;
+			size_t length = (size_t(chunk[0]) << 24) | (chunk[1] << 16) | (chunk[2] << 8) | chunk[3];
+			if (length > bytes.size() - offset - 12)
+				return false;
+			if (std::memcmp(chunk + 4, "IDAT", 4) == 0)
+				zlib.insert(zlib.end(), chunk + 8, chunk + 8 + length);
+			offset += length + 12;
+		}
+		return !zlib.empty();
+	}
+
+	// Inflates the image data of each PNG in the corpus, with the output buffer sized
+	// up front the way the PNG loader does. Non-PNG files are skipped.
+	int runInflate(std::vector<CorpusFile> const & corpus)
+	{
+		int const iterations = 50;
+		std::printf("png inflate: %d iterations per file\n", iterations);
+		std::printf("%-28s %12s %12s %10s %10s\n", "file", "KB in", "KB out", "ms", "MB/s out");
+		for (CorpusFile const & file : corpus) {
+			std::vector<unsigned char> zlib;
+			if (!pngImageData(file.bytes, zlib))
+				continue;
+			int rawLen = 0;
+			char * raw = stbi_zlib_decode_malloc(reinterpret_cast<char const *>(zlib.data()), static_cast<int>(zlib.size()), &rawLen);
+			if (raw == NULL)
+				return -1;
+			stbi_image_free(raw);
+
+			Clock::time_point start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				int outLen;
+				raw = stbi_zlib_decode_malloc_guesssize_headerflag(reinterpret_cast<char const *>(zlib.data()), static_cast<int>(zlib.size()), rawLen, &outLen, 1);
+				if (raw == NULL)
+					return -1;
+				sink = raw[outLen - 1];
+				stbi_image_free(raw);
+			}
+			double ms = msSince(start) / iterations;
+			std::printf("%-28s %12.1f %12.1f %10.3f %10.1f\n", file.path.c_str(), zlib.size() / 1024.0, rawLen / 1024.0, ms,
+				rawLen / (ms * 1048.576));
+		}
+		return 0;
+	}
+
+	void putBigEndian32(std::vector<unsigned char> & out, unsigned v)
+	{
+		for (int shift(24); shift >= 0; shift -= 8)
+			out.push_back(static_cast<unsigned char>(v >> shift));
+	}
+
+	void putPngChunk(std::vector<unsigned char> & png, char const * type, std::vector<unsigned char> const & data)
+	{
+		putBigEndian32(png, static_cast<unsigned>(data.size()));
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), data.begin(), data.end());
+		putBigEndian32(png, 0);	// stb_image doesn't check chunk CRCs
+	}
+
+	// Builds a PNG whose rows all use one filter type, over noise. The image data is
+	// stored rather than compressed, so decoding it costs little besides unfiltering.
+	std::vector<unsigned char> makeFilteredPng(int width, int height, int channels, int depth, int filter)
+	{
+		static unsigned char const COLOR_TYPE[5] = { 0, 0, 4, 2, 6 };
+		size_t rowBytes = static_cast<size_t>(width) * channels * depth / 8;
+		std::vector<unsigned char> rows;
+		unsigned seed = 12345;
+		for (int y(0); y < height; ++y) {
+			rows.push_back(static_cast<unsigned char>(filter));
+			for (size_t i(0); i < rowBytes; ++i) {
+				seed = seed * 1103515245 + 12345;
+				rows.push_back(static_cast<unsigned char>(seed >> 16));
+			}
+		}
+
+		std::vector<unsigned char> zlib = { 0x78, 0x01 };
+		for (size_t offset(0); offset < rows.size(); offset += 65535) {
+			unsigned length = static_cast<unsigned>(std::min<size_t>(65535, rows.size() - offset));
+			unsigned header[5] = { offset + length == rows.size(), length, length >> 8, ~length, ~length >> 8 };
+			for (unsigned byte : header)
+				zlib.push_back(static_cast<unsigned char>(byte));
+			zlib.insert(zlib.end(), rows.begin() + offset, rows.begin() + offset + length);
+		}
+		putBigEndian32(zlib, 0);	// nor the Adler-32 checksum
+
+		std::vector<unsigned char> ihdr;
+		putBigEndian32(ihdr, width);
+		putBigEndian32(ihdr, height);
+		unsigned char format[5] = { static_cast<unsigned char>(depth), COLOR_TYPE[channels], 0, 0, 0 };
+		ihdr.insert(ihdr.end(), format, format + 5);
+
+		std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		putPngChunk(png, "IHDR", ihdr);
+		putPngChunk(png, "IDAT", zlib);
+		putPngChunk(png, "IEND", std::vector<unsigned char>());
+		return png;
+	}
+
+	// Decodes generated PNGs filtered with each of the five row filters, for the pixel
+	// formats the texture path sees. RGB is also decoded to RGBA, which adds the alpha
+	// channel while unfiltering. Doesn't use the corpus.
+	int runUnfilter()
+	{
+		struct Format { char const * name; int channels, depth, reqComp; };
+		static Format const FORMATS[] = { { "rgb8", 3, 8, 0 }, { "rgb8->rgba", 3, 8, 4 }, { "rgba8", 4, 8, 0 },
+			{ "rgb16", 3, 16, 0 }, { "rgba16", 4, 16, 0 } };
+		static char const * const FILTERS[5] = { "none", "sub", "up", "avg", "paeth" };
+		int const width = 1024, height = 1024, iterations = 20;
+
+		std::printf("png unfilter: %dx%d, %d iterations, MPix/s\n", width, height, iterations);
+		std::printf("%-12s", "format");
+		for (char const * filter : FILTERS)
+			std::printf(" %10s", filter);
+		std::printf("\n");
+		for (Format const & format : FORMATS) {
+			std::printf("%-12s", format.name);
+			for (int filter(0); filter < 5; ++filter) {
+				std::vector<unsigned char> png = makeFilteredPng(width, height, format.channels, format.depth, filter);
+				Clock::time_point start = Clock::now();
+				for (int i(0); i < iterations; ++i) {
+					int w, h, n;
+					void * pixels = format.depth == 16
+						? static_cast<void *>(stbi_load_16_from_memory(png.data(), static_cast<int>(png.size()), &w, &h, &n, format.reqComp))
+						: static_cast<void *>(stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &w, &h, &n, format.reqComp));
+					if (pixels == NULL)
+						return -1;
+					stbi_image_free(pixels);
+				}
+				std::printf(" %10.1f", static_cast<double>(width) * height * iterations / (msSince(start) * 1000.0));
+			}
+			std::printf("\n");
+		}
+		return 0;
+	}
+
+	// Builds a Radiance .hdr of noise with run-length coded scanlines, the layout every
+	// writer uses, but with literal spans only.
+	std::vector<unsigned char> makeRgbeHdr(int width, int height)
+	{
+		char header[96];
+		int length = std::snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+		std::vector<unsigned char> hdr(header, header + length);
+		unsigned seed = 12345;
+		for (int y(0); y < height; ++y) {
+			unsigned char start[4] = { 2, 2, static_cast<unsigned char>(width >> 8), static_cast<unsigned char>(width) };
+			hdr.insert(hdr.end(), start, start + 4);
+			for (int c(0); c < 4; ++c) {
+				for (int x(0); x < width; x += 128) {
+					int span = std::min(128, width - x);
+					hdr.push_back(static_cast<unsigned char>(span));
+					for (int i(0); i < span; ++i) {
+						seed = seed * 1103515245 + 12345;
+						// exponents around 128 keep the values near 1, like a lit scene
+						hdr.push_back(static_cast<unsigned char>(c < 3 ? seed >> 16 : 124 + ((seed >> 16) & 7)));
+					}
+				}
+			}
+		}
+		return hdr;
+	}
+
+	// Times the float paths of stb_image: a generated .hdr decoded to float (RGBE expansion)
+	// and to 8 bits (tone mapping through the gamma curve), and the corpus decoded to float.
+	int runHdr(std::vector<CorpusFile> const & corpus)
+	{
+		int const width = 2048, height = 1024, iterations = 10;
+		std::vector<unsigned char> hdr = makeRgbeHdr(width, height);
+		int len = static_cast<int>(hdr.size());
+		std::printf("float conversions: %d iterations, ms per decode\n", iterations);
+		std::printf("%-28s %12s %10s %10s\n", "file", "size", "ms", "MPix/s");
+
+		struct Case { char const * name; bool toFloat; int reqComp; };
+		static Case const CASES[] = { { "hdr -> float rgb", true, 3 }, { "hdr -> float rgba", true, 4 }, { "hdr -> 8-bit rgb", false, 3 }, { "hdr -> 8-bit rgba", false, 4 } };
+		for (Case const & c : CASES) {
+			Clock::time_point start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				int w, h, n;
+				void * pixels = c.toFloat
+					? static_cast<void *>(stbi_loadf_from_memory(hdr.data(), len, &w, &h, &n, c.reqComp))
+					: static_cast<void *>(stbi_load_from_memory(hdr.data(), len, &w, &h, &n, c.reqComp));
+				if (pixels == NULL)
+					return -1;
+				stbi_image_free(pixels);
+			}
+			double ms = msSince(start) / iterations;
+			char dims[32];
+			std::snprintf(dims, sizeof(dims), "%dx%d", width, height);
+			std::printf("%-28s %12s %10.2f %10.1f\n", c.name, dims, ms, static_cast<double>(width) * height / (ms * 1000.0));
+		}
+
+		for (CorpusFile const & file : corpus) {
+			int w, h, n;
+			Clock::time_point start = Clock::now();
+			for (int i(0); i < iterations; ++i) {
+				float * pixels = stbi_loadf_from_memory(file.bytes.data(), static_cast<int>(file.bytes.size()), &w, &h, &n, 4);
+				if (pixels == NULL)
+					return -1;
+				stbi_image_free(pixels);
+			}
+			double ms = msSince(start) / iterations;
+			char dims[32];
+			std::snprintf(dims, sizeof(dims), "%dx%d", w, h);
+			std::printf("%-28s %12s %10.2f %10.1f\n", file.path.c_str(), dims, ms, static_cast<double>(w) * h / (ms * 1000.0));
+		}
+		return 0;
+	}
+	// Builds an uncompressed, top-down TGA of noise: grey for 1 or 2 channels, BGR(A) for 3 or 4.
+	// There's next to no decoding to do, so loads of it are mostly copying and conversion.
+	std::vector<unsigned char> makeRawTga(int width, int height, int channels)
+	{
+		unsigned char header[18] = {};
+		header[2] = static_cast<unsigned char>(channels >= 3 ? 2 : 3);
+		header[12] = static_cast<unsigned char>(width);
+		header[13] = static_cast<unsigned char>(width >> 8);
+		header[14] = static_cast<unsigned char>(height);
+		header[15] = static_cast<unsigned char>(height >> 8);
+		header[16] = static_cast<unsigned char>(channels * 8);
+		header[17] = 0x20;
+		std::vector<unsigned char> tga(header, header + sizeof(header));
+		unsigned seed = 12345;
+		for (size_t i(0), n(static_cast<size_t>(width) * height * channels); i < n; ++i) {
+			seed = seed * 1103515245 + 12345;
+			tga.push_back(static_cast<unsigned char>(seed >> 16));
+		}
+		return tga;
+	}
+
+	// Times stbi__convert_format: each image is loaded as it is and converted to another channel
+	// count, and the difference is the cost of the conversion.
+	int runConvert()
+	{
+		struct Size { int width, height; };
+		static Size const SIZES[] = { { 64, 64 }, { 256, 256 }, { 1024, 1024 }, { 4096, 2048 } };
+		struct Pair { int channels, reqComp; };
+		static Pair const PAIRS[] = { { 1, 3 }, { 1, 4 }, { 2, 4 }, { 3, 4 }, { 4, 3 }, { 4, 1 } };
+		std::printf("channel conversion: ms per load, as stored vs. converted\n");
+		std::printf("%-12s %6s %10s %10s %10s %10s\n", "size", "comp", "stored", "converted", "convert", "MPix/s");
+
+		for (Size const & size : SIZES) {
+			// enough loads of the small images to be measurable
+			int iterations = std::max(4, (1 << 24) / (size.width * size.height));
+			char dims[32];
+			std::snprintf(dims, sizeof(dims), "%dx%d", size.width, size.height);
+			for (Pair const & pair : PAIRS) {
+				std::vector<unsigned char> tga = makeRawTga(size.width, size.height, pair.channels);
+				int len = static_cast<int>(tga.size());
+				double ms[2];
+				for (int converted(0); converted < 2; ++converted) {
+					Clock::time_point start = Clock::now();
+					for (int i(0); i < iterations; ++i) {
+						int w, h, n;
+						stbi_uc * pixels = stbi_load_from_memory(tga.data(), len, &w, &h, &n, converted ? pair.reqComp : pair.channels);
+						if (pixels == NULL)
+							return -1;
+						sink += pixels[0];
+						stbi_image_free(pixels);
+					}
+					ms[converted] = msSince(start) / iterations;
+				}
+				double convertMs = std::max(ms[1] - ms[0], 0.0);
+				char comp[16];
+				std::snprintf(comp, sizeof(comp), "%d->%d", pair.channels, pair.reqComp);
+				std::printf("%-12s %6s %10.3f %10.3f %10.3f %10.1f\n", dims, comp, ms[0], ms[1], convertMs,
+					convertMs > 0.0 ? static_cast<double>(size.width) * size.height / (convertMs * 1000.0) : 0.0);
+			}
+		}
+		return 0;
+	}
+	// stb_image's phase timer, in ms
+	double phaseClock()
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now().time_since_epoch()).count();
+	}
+
+	void putJsonString(std::string const & text)
+	{
+		std::putchar('"');
+		for (char c : text) {
+			if (c == '"' || c == '\\')
+				std::putchar('\\');
+			if (static_cast<unsigned char>(c) >= 0x20)
+				std::putchar(c);
+		}
+		std::putchar('"');
+	}
+
+	struct DecodeReport
+	{
+		std::string name;
+		std::string format;
+		int width, height;
+		size_t bytes;
+		int iterations;
+		double ms;						// per decode, like the rest
+		double phaseMs[STBI_PHASE_COUNT];
+		double allocations;
+		size_t peakBytes;
+	};
+
+	void putReportNumbers(size_t bytes, double pixels, double ms, double const * phaseMs, double allocations, size_t peakBytes)
+	{
+		static char const * const PHASES[STBI_PHASE_COUNT] = { "entropy", "transform", "color", "flip" };
+		std::printf("\"ms\": %.4f, \"mb_per_s\": %.2f, \"mpix_per_s\": %.2f, \"allocations\": %.1f, \"peak_bytes\": %zu, \"phases_ms\": { ",
+			ms, bytes / 1048576.0 / (ms / 1000.0), pixels / (ms * 1000.0), allocations, peakBytes);
+		double counted = 0.0;
+		for (int p(0); p < STBI_PHASE_COUNT; ++p) {
+			std::printf("\"%s\": %.4f, ", PHASES[p], phaseMs[p]);
+			counted += phaseMs[p];
+		}
+		// headers, and the formats stb_image doesn't break down
+		std::printf("\"other\": %.4f }", std::max(ms - counted, 0.0));
+	}
+
+	// Decodes each image of the corpus as the loader does (RGBA, flipped for GL, inside a decode
+	// arena) for a quarter of a second or so, and reports it and the totals per format as JSON.
+	// Generated images are added so every run covers the same ground whatever files it's given.
+	int runReport(std::vector<CorpusFile> corpus)
+	{
+		int const reqComp = 4;
+		double const targetMs = 250.0;
+
+		struct Generated { char const * name; std::vector<unsigned char> bytes; };
+		Generated const GENERATED[] = {
+			{ "generated/rgb-paeth.png", makeFilteredPng(1024, 1024, 3, 8, 4) },
+			{ "generated/rgba-up.png", makeFilteredPng(1024, 1024, 4, 8, 2) },
+			{ "generated/grey.tga", makeRawTga(1024, 1024, 1) },
+			{ "generated/rgba.tga", makeRawTga(1024, 1024, 4) },
+			{ "generated/noise.hdr", makeRgbeHdr(1024, 512) },
+		};
+		for (Generated const & generated : GENERATED) {
+			CorpusFile file;
+			file.path = generated.name;
+			file.bytes = generated.bytes;
+			corpus.push_back(std::move(file));
+		}
+
+		double phases[STBI_PHASE_COUNT];
+		stbi_set_phase_timer_thread(&phaseClock, phases);
+		stbi_set_flip_vertically_on_load_thread(1);
+
+		std::vector<DecodeReport> reports;
+		for (CorpusFile const & file : corpus) {
+			DecodeReport report;
+			report.name = file.path;
+			size_t dot = file.path.find_last_of('.');
+			report.format = dot == std::string::npos ? "unknown" : file.path.substr(dot + 1);
+			std::transform(report.format.begin(), report.format.end(), report.format.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+			report.bytes = file.bytes.size();
+			int len = static_cast<int>(file.bytes.size());
+
+			// one decode to warm up and size the arena, and to pick the iteration count
+			Clock::time_point start = Clock::now();
+			{
+				DecodeArena::Scope scope;
+				int n;
+				stbi_uc * pixels = stbi_load_from_memory(file.bytes.data(), len, &report.width, &report.height, &n, reqComp);
+				if (pixels == NULL) {
+					std::fprintf(stderr, "can't decode \"%s\": %s\n", file.path.c_str(), stbi_failure_reason());
+					return -1;
+				}
+				stbi_image_free(pixels);
+			}
+			report.iterations = static_cast<int>(std::min(std::max(targetMs / std::max(msSince(start), 0.001), 3.0), 1000.0));
+
+			std::fill(phases, phases + STBI_PHASE_COUNT, 0.0);
+			DecodeArena::ResetTotals();
+			start = Clock::now();
+			for (int i(0); i < report.iterations; ++i) {
+				DecodeArena::Scope scope;
+				int w, h, n;
+				stbi_uc * pixels = stbi_load_from_memory(file.bytes.data(), len, &w, &h, &n, reqComp);
+				if (pixels == NULL)
+					return -1;
+				sink += pixels[0];
+				stbi_image_free(pixels);
+			}
+			report.ms = msSince(start) / report.iterations;
+			for (int p(0); p < STBI_PHASE_COUNT; ++p)
+				report.phaseMs[p] = phases[p] / report.iterations;
+			DecodeAllocStats allocs = DecodeArena::Totals();
+			report.allocations = allocs.images ? static_cast<double>(allocs.allocations) / allocs.images : 0.0;
+			report.peakBytes = allocs.peakBytes;
+			reports.push_back(report);
+		}
+		stbi_set_phase_timer_thread(NULL, NULL);
+
+		std::printf("{\n  \"req_comp\": %d,\n  \"images\": [\n", reqComp);
+		for (size_t i(0); i < reports.size(); ++i) {
+			DecodeReport const & r = reports[i];
+			std::printf("    { \"name\": ");
+			putJsonString(r.name);
+			std::printf(", \"format\": ");
+			putJsonString(r.format);
+			std::printf(", \"width\": %d, \"height\": %d, \"bytes\": %zu, \"iterations\": %d, ", r.width, r.height, r.bytes, r.iterations);
+			putReportNumbers(r.bytes, static_cast<double>(r.width) * r.height, r.ms, r.phaseMs, r.allocations, r.peakBytes);
+			std::printf(" }%s\n", i + 1 < reports.size() ? "," : "");
+		}
+
+		// a format's numbers are for decoding each of its images once
+		std::map<std::string, DecodeReport> formats;
+		std::map<std::string, int> imageCounts;
+		std::map<std::string, double> pixelCounts;
+		for (DecodeReport const & r : reports) {
+			auto found = formats.find(r.format);
+			if (found == formats.end()) {
+				formats[r.format] = r;
+			}
+			else {
+				DecodeReport & total = found->second;
+				total.bytes += r.bytes;
+				total.ms += r.ms;
+				for (int p(0); p < STBI_PHASE_COUNT; ++p)
+					total.phaseMs[p] += r.phaseMs[p];
+				total.allocations += r.allocations;
+				total.peakBytes = std::max(total.peakBytes, r.peakBytes);
+			}
+			++imageCounts[r.format];
+			pixelCounts[r.format] += static_cast<double>(r.width) * r.height;
+		}
+		std::printf("  ],\n  \"formats\": {\n");
+		size_t remaining = formats.size();
+		for (auto const & entry : formats) {
+			DecodeReport const & total = entry.second;
+			int images = imageCounts[entry.first];
+			std::printf("    ");
+			putJsonString(entry.first);
+			std::printf(": { \"images\": %d, \"bytes\": %zu, ", images, total.bytes);
+			putReportNumbers(total.bytes, pixelCounts[entry.first], total.ms, total.phaseMs, total.allocations / images, total.peakBytes);
+			std::printf(" }%s\n", --remaining ? "," : "");
+		}
+		std::printf("  }\n}\n");
+		return 0;
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	std::string mode = "scaling";
+	std::vector<std::string> paths;
+	for (int i(1); i < argc; ++i) {
+		if (i == 1 && std::strchr(argv[i], '.') == nullptr)
+			mode = argv[i];
+		else
+			paths.push_back(argv[i]);
+	}
+	if (paths.empty())
+		paths.assign(std::begin(DEFAULT_CORPUS), std::end(DEFAULT_CORPUS));
+
+	if (mode == "unfilter")
+		return runUnfilter();
+	if (mode == "convert")
+		return runConvert();
+	if (mode == "tilecache")
+		return runTileCache();
+
+	std::vector<CorpusFile> corpus;
+	if (!readCorpus(paths, corpus))
+		return -1;
+
+	if (mode == "scaling")
+		return runScaling(corpus);
+	if (mode == "io")
+		return runIo(corpus);
+	if (mode == "jpeg")
+		return runJpeg(corpus);
+	if (mode == "restart")
+		return runRestart(corpus);
+	if (mode == "scaled")
+		return runScaled(corpus);
+	if (mode == "into")
+		return runInto(corpus);
+	if (mode == "stream")
+		return runStream(corpus);
+	if (mode == "gif")
+		return runGif(corpus);
+	if (mode == "inflate")
+		return runInflate(corpus);
+	if (mode == "hdr")
+		return runHdr(corpus);
+	if (mode == "report")
+		return runReport(corpus);
+	std::printf("unknown benchmark \"%s\"\n", mode.c_str());
+	return -1;
+}